@@ -27,7 +27,13 @@
 #include <sstream>
 #include <iomanip>
 #include <regex>
+#include <unistd.h>
+#include <poll.h>
 #include "HttpRequesting.h"
+#if dHttpEngineEpoll
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 
 #define dForEach_ProcState(gen) \
 		gen(StStart) \
@@ -55,13 +61,47 @@ dProcessStateStr(ProcState);
 
 using namespace std;
 
-//#define ENABLE_CURL_SHARE
+HttpMulti HttpRequesting::multiGlobal;
+atomic<bool> HttpRequesting::multiDeInitRegistered(false);
+#if dHttpEngineEpoll
+thread *HttpRequesting::pThdEngine = NULL;
+thread::id HttpRequesting::idEngine;
+atomic<bool> HttpRequesting::engineActive(false);
+atomic<bool> HttpRequesting::engineStopReq(false);
+int HttpRequesting::fdEngineWake = -1;
 
-mutex HttpRequesting::mtxCurlMulti;
-CURLM *HttpRequesting::pCurlMulti = NULL;
+const int cNumEventsEngineMax = 32;
+#endif
+#if CONFIG_PROC_HAVE_DRIVERS
+atomic<bool> HttpRequesting::multiPerThread(false);
+mutex HttpRequesting::mtxMultisLocal;
+list<HttpMulti> HttpRequesting::multisLocal;
+list<HttpMulti *> HttpRequesting::multisLocalFree;
+thread_local HttpRequesting::MultiLocal HttpRequesting::multiLocal;
+#endif
 
 mutex HttpRequesting::sessionMtx;
 list<HttpSession> HttpRequesting::sessions;
+bool HttpRequesting::sessionsDeInitRegistered = false;
+
+mutex HttpRequesting::mtxEasyPool;
+list<HttpEasyIdle> HttpRequesting::easyPool;
+bool HttpRequesting::easyPoolDeInitRegistered = false;
+
+/*
+ * Idle easy handles keep their TLS session cache
+ * and are reused by requests to the same scheme,
+ * host and port. Oldest handles are dropped first
+ */
+const size_t cNumEasyIdleMax = 32;
+
+/*
+ * Shared sessions without references are kept for
+ * later requests to the same destination. Expired
+ * or surplus idle sessions are removed
+ */
+const uint32_t cMsSessionIdleMax = 60000;
+const size_t cNumSessionsMax = 16;
 
 HttpRequesting::HttpRequesting()
 	: Processing("HttpRequesting")
@@ -82,10 +122,12 @@ HttpRequesting::HttpRequesting()
 	, mVersionTls("")
 	, mVersionHttp("HTTP/2")
 	, mModeDebug(false)
+	, mSessionShare(false)
 #if CONFIG_LIB_DSPC_HAVE_C_ARES
 	, mpResolv(NULL)
 #endif
 	, mpCurl(NULL)
+	, mpMulti(NULL)
 	, mCurlBound(false)
 	, mpListHeader(NULL)
 	, mpListResolv(NULL)
@@ -93,13 +135,21 @@ HttpRequesting::HttpRequesting()
 	, mRespCode(0)
 	, mRespHdr("")
 	, mRespData()
+	, mpFctSink(NULL)
+	, mpUserSink(NULL)
+	, mFdSink(-1)
+	, mFdSinkAutoClose(false)
+	, mpTransSink(NULL)
+	, mLenSinkDone(0)
+	, mSinkPaused(false)
+	, mSession()
+	, mSessionRef(false)
 #if 0 // TODO: Implement
 	, mRetries(2)
 #endif
 	, mDoneCurl(Pending)
 {
 	mState = StStart;
-	mpCurl = curl_easy_init();
 }
 
 HttpRequesting::HttpRequesting(const string &url)
@@ -121,10 +171,12 @@ HttpRequesting::HttpRequesting(const string &url)
 	, mVersionTls("")
 	, mVersionHttp("")
 	, mModeDebug(false)
+	, mSessionShare(false)
 #if CONFIG_LIB_DSPC_HAVE_C_ARES
 	, mpResolv(NULL)
 #endif
 	, mpCurl(NULL)
+	, mpMulti(NULL)
 	, mCurlBound(false)
 	, mpListHeader(NULL)
 	, mpListResolv(NULL)
@@ -132,13 +184,21 @@ HttpRequesting::HttpRequesting(const string &url)
 	, mRespCode(0)
 	, mRespHdr("")
 	, mRespData()
+	, mpFctSink(NULL)
+	, mpUserSink(NULL)
+	, mFdSink(-1)
+	, mFdSinkAutoClose(false)
+	, mpTransSink(NULL)
+	, mLenSinkDone(0)
+	, mSinkPaused(false)
+	, mSession()
+	, mSessionRef(false)
 #if 0 // TODO: Implement
 	, mRetries(2)
 #endif
 	, mDoneCurl(Pending)
 {
 	mState = StStart;
-	mpCurl = curl_easy_init();
 }
 
 HttpRequesting::~HttpRequesting()
@@ -227,8 +287,67 @@ void HttpRequesting::modeDebugSet(bool en)
 	mModeDebug = en;
 }
 
+void HttpRequesting::sessionShareSet(bool en)
+{
+	mSessionShare = en;
+}
+
+/*
+ * Each driver or worker thread uses its own multi handle
+ * for requests bound afterwards. Transfers are driven by
+ * the requests ticked on that thread. No global lock is
+ * taken on the hot path
+ */
+void HttpRequesting::multiPerThreadSet(bool en)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	multiPerThread = en;
+#else
+	(void)en;
+#endif
+}
+
+/*
+ * Streaming output
+ *
+ * The response body is passed chunk by chunk to the sink
+ * instead of being collected in respBytes(). A sink which
+ * is not ready pauses the transfer. The process resumes it
+ * on one of the next ticks.
+ *
+ * Literature
+ * - https://curl.se/libcurl/c/CURLOPT_WRITEFUNCTION.html
+ * - https://curl.se/libcurl/c/curl_easy_pause.html
+ */
+void HttpRequesting::sinkSet(FuncHttpSink pFctSink, void *pUser)
+{
+	mpFctSink = pFctSink;
+	mpUserSink = pUser;
+}
+
+void HttpRequesting::sinkSet(int fd, bool autoClose)
+{
+	if (fd < 0)
+		return;
+
+	mFdSink = fd;
+	mFdSinkAutoClose = autoClose;
+}
+
+void HttpRequesting::sinkSet(Transfering *pTrans)
+{
+	mpTransSink = pTrans;
+}
+
 CURL *HttpRequesting::easyHandleCurl()
 {
+	if (mpCurl || mDoneCurl != Pending)
+		return mpCurl;
+
+	curlGlobalInit();
+
+	mpCurl = curl_easy_init();
+
 	return mpCurl;
 }
 
@@ -266,9 +385,6 @@ Success HttpRequesting::process()
 	{
 	case StStart:
 
-		if (!mpCurl)
-			return procErrLog(-1, "could not initialize curl easy handle");
-
 		if (!mUrl.size())
 			return procErrLog(-1, "url not set");
 
@@ -283,6 +399,12 @@ Success HttpRequesting::process()
 
 		if (!mPort)
 			mPort = mProtocol == "https" ? 443 : 80;
+
+		if (!mpCurl)
+			mpCurl = easyHandleBorrow(easyHandleKey());
+
+		if (!mpCurl)
+			return procErrLog(-1, "could not initialize curl easy handle");
 #if 0
 		procWrnLog("URL           %s", mUrl.c_str());
 		procWrnLog("Protocol      %s", mProtocol.c_str());
@@ -387,15 +509,22 @@ Success HttpRequesting::process()
 
 		break;
 	case StReqStart:
-
-		multiProcess();
+#if dHttpEngineEpoll
+		if (mpMulti != &multiGlobal || !engineActive)
+#endif
+			multiProcess(mpMulti);
 
 		mState = StReqDoneWait;
 
 		break;
 	case StReqDoneWait:
 
-		multiProcess();
+		sinkResume();
+#if dHttpEngineEpoll
+		// Completed by the engine thread
+		if (mpMulti != &multiGlobal || !engineActive)
+#endif
+			multiProcess(mpMulti);
 
 		if (mDoneCurl == Pending)
 			break;
@@ -428,9 +557,25 @@ Success HttpRequesting::shutdown()
 
 		easyHandleCurlUnbind();
 
+		if (mSessionRef)
+		{
+			if (mpCurl)
+				curl_easy_setopt(mpCurl, CURLOPT_SHARE, NULL);
+
+			sessionTerminate();
+		}
+
 		curlListFree(&mpListHeader);
 		curlListFree(&mpListResolv);
 
+		if (mFdSink >= 0 && mFdSinkAutoClose)
+			::close(mFdSink);
+		mFdSink = -1;
+
+		if (mpTransSink)
+			mpTransSink->doneSet();
+		mpTransSink = NULL;
+
 		return Positive;
 
 		break;
@@ -449,55 +594,40 @@ Success HttpRequesting::shutdown()
  */
 Success HttpRequesting::easyHandleCurlBind()
 {
+	HttpMulti *pMulti = multiGet();
+	CURLMcode code;
+
+	if (!pMulti)
+		return procErrLog(-1, "could not get curl multi handle");
 #if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mtxCurlMulti);
+	Guard lock(pMulti->mtx);
 #endif
-	if (!pCurlMulti)
-		pCurlMulti = multiHandleCurlInit();
-
-	if (!pCurlMulti)
+	if (!pMulti->pMulti && !multiInit(pMulti))
 		return procErrLog(-1, "curl multi handle not set");
 
-	CURLMcode code;
-
-	code = curl_multi_add_handle(pCurlMulti, mpCurl);
+	code = curl_multi_add_handle(pMulti->pMulti, mpCurl);
 	if (code != CURLM_OK)
 		return procErrLog(-1, "could not bind curl easy handle");
 
+	mpMulti = pMulti;
 	mCurlBound = true;
 
 	return Positive;
 }
 
-CURLM *HttpRequesting::multiHandleCurlInit()
-{
-	CURLM *pMulti;
-
-	Processing::globalDestructorRegister(curlMultiDeInit);
-
-	pMulti = curl_multi_init();
-	if (!pMulti)
-		return NULL;
-#if 0
-	curl_multi_setopt(pMulti, CURLMOPT_MAX_HOST_CONNECTIONS, 5L);
-	curl_multi_setopt(pMulti, CURLMOPT_MAX_TOTAL_CONNECTIONS, 10L);
-#endif
-	dbgLog("global init curl multi done");
-
-	return pMulti;
-}
-
 void HttpRequesting::easyHandleCurlUnbind()
 {
+	if (!mpMulti)
+		return;
 #if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mtxCurlMulti);
+	Guard lock(mpMulti->mtx);
 #endif
 	if (!mCurlBound)
 		return;
 
 	CURLMcode code;
 
-	code = curl_multi_remove_handle(pCurlMulti, mpCurl);
+	code = curl_multi_remove_handle(mpMulti->pMulti, mpCurl);
 	if (code != CURLM_OK)
 		procWrnLog("could not unbind curl easy handle");
 
@@ -562,10 +692,9 @@ Success HttpRequesting::easyHandleCurlConfigure()
 	procDbgLog("authMethod = %s", mAuthMethod.c_str());
 	procDbgLog("versionTls = %s", versionTls.c_str());
 #endif
-#ifdef ENABLE_CURL_SHARE
-	if (sessionCreate(address, port) != Positive)
+	if (mSessionShare && !mSessionRef &&
+			sessionCreate(easyHandleKey()) != Positive)
 		return procErrLog(-1, "could not create session");
-#endif
 	curl_easy_setopt(mpCurl, CURLOPT_URL, mUrl.c_str());
 
 	if (mPort)
@@ -657,14 +786,22 @@ Success HttpRequesting::easyHandleCurlConfigure()
 	curl_easy_setopt(mpCurl, CURLOPT_HEADERFUNCTION, HttpRequesting::curlDataToStringWrite);
 	curl_easy_setopt(mpCurl, CURLOPT_HEADERDATA, &mRespHdr);
 
-	curl_easy_setopt(mpCurl, CURLOPT_WRITEFUNCTION, HttpRequesting::curlDataToByteVecWrite);
-	curl_easy_setopt(mpCurl, CURLOPT_WRITEDATA, &mRespData);
+	if (sinkUsed())
+	{
+		curl_easy_setopt(mpCurl, CURLOPT_WRITEFUNCTION, HttpRequesting::curlDataToSinkWrite);
+		curl_easy_setopt(mpCurl, CURLOPT_WRITEDATA, this);
+	} else {
+		curl_easy_setopt(mpCurl, CURLOPT_WRITEFUNCTION, HttpRequesting::curlDataToByteVecWrite);
+		curl_easy_setopt(mpCurl, CURLOPT_WRITEDATA, &mRespData);
+	}
 
 	curl_easy_setopt(mpCurl, CURLOPT_PRIVATE, this);
-#ifdef ENABLE_CURL_SHARE
-	curl_easy_setopt(mpCurl, CURLOPT_COOKIEFILE, "");
-	curl_easy_setopt(mpCurl, CURLOPT_SHARE, mSession->pCurlShare);
-#endif
+
+	if (mSessionRef)
+	{
+		curl_easy_setopt(mpCurl, CURLOPT_COOKIEFILE, "");
+		curl_easy_setopt(mpCurl, CURLOPT_SHARE, mSession->pCurlShare);
+	}
 	if (mModeDebug)
 	{
 		procWrnLog("verbose mode set");
@@ -690,12 +827,19 @@ errCleanupCurl:
 	curlListFree(&mpListResolv);
 
 	curl_easy_cleanup(mpCurl);
-#ifdef ENABLE_CURL_SHARE
-	sessionTerminate();
-#endif
+	mpCurl = NULL;
+
+	if (mSessionRef)
+		sessionTerminate();
+
 	return success;
 }
 
+string HttpRequesting::easyHandleKey() const
+{
+	return mProtocol + "://" + mNameHost + ":" + to_string(mPort);
+}
+
 /*
  * Literature libcurl
  * - https://curl.se/libcurl/c/libcurl-share.html
@@ -708,7 +852,7 @@ errCleanupCurl:
  * - https://curl.se/libcurl/c/threaded-shared-conn.html
  * - https://curl.se/libcurl/c/threaded-ssl.html
  */
-Success HttpRequesting::sessionCreate(const string &address, const uint16_t port)
+Success HttpRequesting::sessionCreate(const string &key)
 {
 #if CONFIG_PROC_HAVE_DRIVERS
 	Guard lock(sessionMtx);
@@ -716,14 +860,20 @@ Success HttpRequesting::sessionCreate(const string &address, const uint16_t port
 	list<HttpSession>::iterator iter;
 	bool sessionFound = false;
 
-	procDbgLog("remote socket for session: %s:%d", address.c_str(), port);
-	procDbgLog("current number of sessions: %d", sessions.size());
+	if (!sessionsDeInitRegistered)
+	{
+		Processing::globalDestructorRegister(sessionsDeInit);
+		sessionsDeInitRegistered = true;
+	}
+
+	sessionsIdleRemove(millis(), false);
+
+	procDbgLog("key for session: %s", key.c_str());
+	procDbgLog("current number of sessions: %zu", sessions.size());
 
 	for (iter = sessions.begin(); iter != sessions.end(); ++iter)
 	{
-		procDbgLog("%d %s %d", iter->numReferences, iter->address.c_str(), iter->port);
-
-		if (iter->address == address && iter->port == port)
+		if (iter->key == key)
 		{
 			mSession = iter;
 			sessionFound = true;
@@ -731,10 +881,6 @@ Success HttpRequesting::sessionCreate(const string &address, const uint16_t port
 		}
 	}
 
-	// uncomment if you want to use only one request per session
-	// not recommendet
-	//sessionFound = false;
-
 	if (sessionFound)
 	{
 		procDbgLog("reusing existing session");
@@ -743,36 +889,24 @@ Success HttpRequesting::sessionCreate(const string &address, const uint16_t port
 	} else {
 		procDbgLog("no existing session found. Creating");
 
-		HttpSession session = {};
-		sessions.push_front(session);
+		if (sessions.size() >= cNumSessionsMax)
+			sessionsIdleRemove(millis(), true);
+
+		sessions.emplace_front();
 		mSession = sessions.begin();
 
 		mSession->numReferences = 1;
 		mSession->maxReferences = 1;
-		mSession->address = address;
-		mSession->port = port;
-
-		mSession->sharedDataMtxList.resize(numSharedDataTypes, NULL);
+		mSession->msIdleStart = 0;
+		mSession->key = key;
 
-		for (size_t i = 0; i < numSharedDataTypes; ++i)
-		{
-			mSession->sharedDataMtxList[i] = new dNoThrow mutex;
-
-			if (!mSession->sharedDataMtxList[i])
-			{
-				sharedDataMtxListDelete();
-				sessions.erase(mSession);
-
-				return procErrLog(-1, "could not allocate shared data mutexes for session");
-			}
-		}
+		for (size_t i = 0; i < CURL_LOCK_DATA_LAST; ++i)
+			mSession->lockedExclusive[i] = false;
 
 		mSession->pCurlShare = curl_share_init();
 		if (!mSession->pCurlShare)
 		{
-			sharedDataMtxListDelete();
 			sessions.erase(mSession);
-
 			return procErrLog(-1, "curl_share_init() returned 0");
 		}
 
@@ -783,24 +917,25 @@ Success HttpRequesting::sessionCreate(const string &address, const uint16_t port
 		code += curl_share_setopt(mSession->pCurlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
 		code += curl_share_setopt(mSession->pCurlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
 
-		code += curl_share_setopt(mSession->pCurlShare, CURLSHOPT_USERDATA, &mSession->sharedDataMtxList);
+		code += curl_share_setopt(mSession->pCurlShare, CURLSHOPT_USERDATA, &*mSession);
 		code += curl_share_setopt(mSession->pCurlShare, CURLSHOPT_LOCKFUNC, HttpRequesting::sharedDataLock);
 		code += curl_share_setopt(mSession->pCurlShare, CURLSHOPT_UNLOCKFUNC, HttpRequesting::sharedDataUnLock);
 
 		if (code != CURLSHE_OK)
 		{
 			curl_share_cleanup(mSession->pCurlShare);
-			sharedDataMtxListDelete();
 			sessions.erase(mSession);
 
 			return procErrLog(-1, "curl_share_setopt() failed");
 		}
 	}
 
+	mSessionRef = true;
+
 	if (mSession->numReferences > mSession->maxReferences)
 		mSession->maxReferences = mSession->numReferences;
 
-	procDbgLog("current number of session references: %d", mSession->numReferences);
+	procDbgLog("current number of session references: %zu", mSession->numReferences);
 
 	return Positive;
 }
@@ -810,27 +945,57 @@ void HttpRequesting::sessionTerminate()
 #if CONFIG_PROC_HAVE_DRIVERS
 	Guard lock(sessionMtx);
 #endif
-	procDbgLog("dereferencing session: %s:%d", mSession->address.c_str(), mSession->port);
+	procDbgLog("dereferencing session: %s", mSession->key.c_str());
+
+	mSessionRef = false;
 
 	--mSession->numReferences;
-	procDbgLog("%d session references left", mSession->numReferences);
+	procDbgLog("%zu session references left", mSession->numReferences);
 
 	if (mSession->numReferences)
 		return;
 
-	procDbgLog("terminating session. max number of session references were %d",
+	procDbgLog("session idle. max number of session references were %zu",
 		mSession->maxReferences);
 
-	curl_share_cleanup(mSession->pCurlShare);
-	sharedDataMtxListDelete();
-	sessions.erase(mSession);
+	// Kept for reuse. See sessionsIdleRemove()
+	mSession->msIdleStart = millis();
 }
 
-void HttpRequesting::sharedDataMtxListDelete()
+bool HttpRequesting::sinkUsed() const
 {
-	size_t i = 0;
-	while (i < numSharedDataTypes && mSession->sharedDataMtxList[i])
-		delete mSession->sharedDataMtxList[i++];
+	return mpFctSink || mFdSink >= 0 || mpTransSink;
+}
+
+void HttpRequesting::sinkResume()
+{
+	struct pollfd pfd;
+
+	if (!mSinkPaused)
+		return;
+
+	if (mpTransSink && !mpTransSink->mSendReady)
+		return;
+
+	if (mFdSink >= 0)
+	{
+		pfd.fd = mFdSink;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+
+		if (poll(&pfd, 1, 0) <= 0)
+			return;
+	}
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mpMulti->mtx);
+#endif
+	if (!mCurlBound)
+		return;
+
+	mSinkPaused = false;
+
+	// May call the write function again
+	curl_easy_pause(mpCurl, CURLPAUSE_CONT);
 }
 
 void HttpRequesting::processInfo(char *pBuf, char *pBufEnd)
@@ -843,6 +1008,100 @@ void HttpRequesting::processInfo(char *pBuf, char *pBufEnd)
 
 /* static functions */
 
+HttpMulti *HttpRequesting::multiGet()
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	if (!multiPerThread)
+		return &multiGlobal;
+
+	if (multiLocal.pMulti)
+		return multiLocal.pMulti;
+
+	Guard lock(mtxMultisLocal);
+
+	if (multisLocalFree.size())
+	{
+		multiLocal.pMulti = multisLocalFree.front();
+		multisLocalFree.pop_front();
+
+		return multiLocal.pMulti;
+	}
+
+	multisLocal.emplace_back();
+	multiLocal.pMulti = &multisLocal.back();
+
+	return multiLocal.pMulti;
+#else
+	return &multiGlobal;
+#endif
+}
+
+#if CONFIG_PROC_HAVE_DRIVERS
+// Requests still bound to the multi handle keep using it
+HttpRequesting::MultiLocal::~MultiLocal()
+{
+	if (!pMulti)
+		return;
+
+	Guard lock(mtxMultisLocal);
+	multisLocalFree.push_back(pMulti);
+}
+#endif
+
+// Caller must hold the mutex of the multi handle
+bool HttpRequesting::multiInit(HttpMulti *pMulti)
+{
+	if (!multiDeInitRegistered.exchange(true))
+		Processing::globalDestructorRegister(curlMultiDeInit);
+
+	pMulti->pMulti = curl_multi_init();
+	if (!pMulti->pMulti)
+		return false;
+#if 0
+	curl_multi_setopt(pMulti->pMulti, CURLMOPT_MAX_HOST_CONNECTIONS, 5L);
+	curl_multi_setopt(pMulti->pMulti, CURLMOPT_MAX_TOTAL_CONNECTIONS, 10L);
+#endif
+#if dHttpEngineEpoll
+	pMulti->fdEpoll = epoll_create1(EPOLL_CLOEXEC);
+	if (pMulti->fdEpoll < 0)
+	{
+		errLog(-1, "could not create epoll instance: %s", strerror(errno));
+		return true; // Polling
+	}
+
+	pMulti->deadlineSet = false;
+
+	curl_multi_setopt(pMulti->pMulti, CURLMOPT_SOCKETFUNCTION, curlSocketCb);
+	curl_multi_setopt(pMulti->pMulti, CURLMOPT_SOCKETDATA, pMulti);
+	curl_multi_setopt(pMulti->pMulti, CURLMOPT_TIMERFUNCTION, curlTimerCb);
+	curl_multi_setopt(pMulti->pMulti, CURLMOPT_TIMERDATA, pMulti);
+
+	if (pMulti == &multiGlobal && !engineStart())
+		wrnLog("could not start curl engine. Polling");
+#endif
+	dbgLog("init curl multi done");
+
+	return true;
+}
+
+void HttpRequesting::multiDeInit(HttpMulti *pMulti)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(pMulti->mtx);
+#endif
+	if (!pMulti->pMulti)
+		return;
+
+	curl_multi_cleanup(pMulti->pMulti);
+	pMulti->pMulti = NULL;
+#if dHttpEngineEpoll
+	if (pMulti->fdEpoll >= 0)
+		close(pMulti->fdEpoll);
+	pMulti->fdEpoll = -1;
+#endif
+	dbgLog("deinit curl multi done");
+}
+
 /*
  * Literature
  * - https://curl.se/libcurl/c/curl_multi_perform.html
@@ -850,19 +1109,53 @@ void HttpRequesting::processInfo(char *pBuf, char *pBufEnd)
  * - https://curl.se/libcurl/c/CURLINFO_RESPONSE_CODE.html
  * - https://curl.se/libcurl/c/CURLINFO_PRIVATE.html
  */
-void HttpRequesting::multiProcess()
+void HttpRequesting::multiProcess(HttpMulti *pMulti)
 {
 #if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mtxCurlMulti);
+	Guard lock(pMulti->mtx);
+#endif
+	int numRunningRequests;
+
+	if (!pMulti->pMulti)
+		return;
+#if dHttpEngineEpoll
+	if (pMulti->fdEpoll >= 0)
+	{
+		struct epoll_event events[cNumEventsEngineMax];
+		int numEvents;
+
+		// Only sockets which are ready. Not all transfers
+		numEvents = epoll_wait(pMulti->fdEpoll, events, cNumEventsEngineMax, 0);
+		if (numEvents < 0)
+			numEvents = 0;
+
+		multiSocketsDrive(pMulti, events, numEvents);
+		return;
+	}
 #endif
-	int numRunningRequests, numMsgsLeft;
+	curl_multi_perform(pMulti->pMulti, &numRunningRequests);
+
+	multiDoneCheck(pMulti);
+#if 0
+	--mRetries;
+	if (mRetries)
+	{
+		procDbgLog("retries left %d", mRetries);
+		success = Pending;
+	} else
+		procDbgLog("no retry");
+#endif
+}
+
+// Caller must hold the mutex of the multi handle
+void HttpRequesting::multiDoneCheck(HttpMulti *pMulti)
+{
+	int numMsgsLeft;
 	CURLMsg *curlMsg;
 	CURL *pCurl;
 	HttpRequesting *pReq;
 
-	curl_multi_perform(pCurlMulti, &numRunningRequests);
-
-	while (curlMsg = curl_multi_info_read(pCurlMulti, &numMsgsLeft), curlMsg)
+	while (curlMsg = curl_multi_info_read(pMulti->pMulti, &numMsgsLeft), curlMsg)
 	{
 		//dbgLog("messages left: %d", numMsgsLeft);
 
@@ -884,29 +1177,26 @@ void HttpRequesting::multiProcess()
 		dbgLog("response code   %d", pReq->mRespCode);
 		dbgLog("url             %s", pReq->mUrl.substr(33).c_str());
 #endif
-		curl_multi_remove_handle(pCurlMulti, pCurl);
+		curl_multi_remove_handle(pMulti->pMulti, pCurl);
 		pReq->mCurlBound = false;
 		//dbgLog("easy handle curl unbound");
 
 		curlListFree(&pReq->mpListHeader);
 		curlListFree(&pReq->mpListResolv);
 
-		curl_easy_cleanup(pReq->mpCurl);
+		// Pooled handles must not keep the share
+		if (pReq->mSessionRef)
+			curl_easy_setopt(pCurl, CURLOPT_SHARE, NULL);
+
+		easyHandleReturn(pReq->easyHandleKey(), pReq->mpCurl);
 		pReq->mpCurl = NULL;
-#ifdef ENABLE_CURL_SHARE
-		pReq->sessionTerminate();
-#endif
+
+		if (pReq->mSessionRef)
+			pReq->sessionTerminate();
+
+		// Last access. Request may be deleted afterwards
 		pReq->mDoneCurl = Positive;
 	}
-#if 0
-	--mRetries;
-	if (mRetries)
-	{
-		procDbgLog("retries left %d", mRetries);
-		success = Pending;
-	} else
-		procDbgLog("no retry");
-#endif
 }
 
 /*
@@ -919,41 +1209,440 @@ void HttpRequesting::multiProcess()
  */
 void HttpRequesting::curlMultiDeInit()
 {
+#if dHttpEngineEpoll
+	engineStop();
+#endif
+	multiDeInit(&multiGlobal);
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mtxMultisLocal);
+	list<HttpMulti>::iterator iter;
+
+	for (iter = multisLocal.begin(); iter != multisLocal.end(); ++iter)
+		multiDeInit(&*iter);
+#endif
+}
+
+#if dHttpEngineEpoll
+/*
+ * Sockets and timeouts
+ *
+ * libcurl reports the sockets and the timeout it needs
+ * via callbacks. Only sockets reported ready by epoll are
+ * handed to curl_multi_socket_action(). Idle transfers
+ * cost nothing.
+ *
+ * Literature
+ * - https://curl.se/libcurl/c/curl_multi_socket_action.html
+ * - https://curl.se/libcurl/c/CURLMOPT_SOCKETFUNCTION.html
+ * - https://curl.se/libcurl/c/CURLMOPT_TIMERFUNCTION.html
+ * - https://curl.se/libcurl/c/ephiperfifo.html
+ * - https://man7.org/linux/man-pages/man7/epoll.7.html
+ */
+
+// Caller must hold the mutex of the multi handle
+void HttpRequesting::multiSocketsDrive(HttpMulti *pMulti, struct epoll_event *pEvents, int numEvents)
+{
+	int numRunning, flags, fd;
+	eventfd_t val;
+
+	for (int i = 0; i < numEvents; ++i)
+	{
+		fd = pEvents[i].data.fd;
+
+		if (fd == fdEngineWake)
+		{
+			eventfd_read(fdEngineWake, &val);
+			continue;
+		}
+
+		flags = 0;
+
+		if (pEvents[i].events & EPOLLIN)
+			flags |= CURL_CSELECT_IN;
+		if (pEvents[i].events & EPOLLOUT)
+			flags |= CURL_CSELECT_OUT;
+		if (pEvents[i].events & (EPOLLERR | EPOLLHUP))
+			flags |= CURL_CSELECT_ERR;
+
+		curl_multi_socket_action(pMulti->pMulti, fd, flags, &numRunning);
+	}
+
+	if (!multiTimeoutGet(pMulti))
+	{
+		pMulti->deadlineSet = false;
+		curl_multi_socket_action(pMulti->pMulti, CURL_SOCKET_TIMEOUT, 0, &numRunning);
+	}
+
+	multiDoneCheck(pMulti);
+}
+
+// Caller must hold the mutex of the multi handle
+int HttpRequesting::multiTimeoutGet(HttpMulti *pMulti)
+{
+	chrono::steady_clock::duration diff;
+
+	if (!pMulti->deadlineSet)
+		return -1;
+
+	diff = pMulti->tDeadline - chrono::steady_clock::now();
+	if (diff <= chrono::steady_clock::duration::zero())
+		return 0;
+
+	// Round up. Otherwise the engine wakes up too early
+	return (int)chrono::ceil<chrono::milliseconds>(diff).count();
+}
+
+/*
+ * Transfer engine
+ *
+ * A single thread drives all transfers of the global
+ * multi handle. It sleeps in epoll_wait() until a socket
+ * is ready, the timeout of libcurl expires or a handle is
+ * added. Finished requests are marked done. Their process
+ * only checks this flag.
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/eventfd.2.html
+ */
+
+// Caller must hold the mutex of the global multi handle
+bool HttpRequesting::engineStart()
+{
+	struct epoll_event event;
+	int res;
+
+	fdEngineWake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (fdEngineWake < 0)
+	{
+		errLog(-1, "could not create eventfd: %s", strerror(errno));
+		return false;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = fdEngineWake;
+
+	res = epoll_ctl(multiGlobal.fdEpoll, EPOLL_CTL_ADD, fdEngineWake, &event);
+	if (res)
+	{
+		errLog(-1, "could not add eventfd to epoll: %s", strerror(errno));
+		goto errCleanupWake;
+	}
+
+	engineStopReq = false;
+
+	// Not a static object. Must not terminate the application at exit
+	pThdEngine = new dNoThrow thread(engineRun);
+	if (!pThdEngine)
+	{
+		errLog(-1, "could not create curl engine thread");
+		goto errCleanupWake;
+	}
+
+	engineActive = true;
+
+	dbgLog("curl engine started");
+
+	return true;
+
+errCleanupWake:
+	close(fdEngineWake);
+	fdEngineWake = -1;
+
+	return false;
+}
+
+void HttpRequesting::engineStop()
+{
+	if (!engineActive)
+		return;
+
+	engineStopReq = true;
+	eventfd_write(fdEngineWake, 1);
+
+	pThdEngine->join();
+	delete pThdEngine;
+	pThdEngine = NULL;
+
+	Guard lock(multiGlobal.mtx);
+
+	epoll_ctl(multiGlobal.fdEpoll, EPOLL_CTL_DEL, fdEngineWake, NULL);
+
+	close(fdEngineWake);
+	fdEngineWake = -1;
+
+	engineActive = false;
+
+	dbgLog("curl engine stopped");
+}
+
+void HttpRequesting::engineRun()
+{
+	struct epoll_event events[cNumEventsEngineMax];
+	int numEvents, timeoutMs;
+
+	{
+		Guard lock(multiGlobal.mtx);
+		idEngine = this_thread::get_id();
+	}
+
+	while (!engineStopReq)
+	{
+		{
+			Guard lock(multiGlobal.mtx);
+			timeoutMs = multiTimeoutGet(&multiGlobal);
+		}
+
+		numEvents = epoll_wait(multiGlobal.fdEpoll, events, cNumEventsEngineMax, timeoutMs);
+		if (numEvents < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			errLog(-1, "could not wait for events: %s", strerror(errno));
+			break;
+		}
+
+		Guard lock(multiGlobal.mtx);
+		multiSocketsDrive(&multiGlobal, events, numEvents);
+	}
+}
+
+// Called by libcurl. Mutex of the multi handle is held
+int HttpRequesting::curlSocketCb(CURL *pCurl, curl_socket_t fd, int what, void *pUser, void *pSocket)
+{
+	HttpMulti *pMulti = (HttpMulti *)pUser;
+	struct epoll_event event;
+	int res;
+
+	(void)pCurl;
+
+	if (what == CURL_POLL_REMOVE)
+	{
+		epoll_ctl(pMulti->fdEpoll, EPOLL_CTL_DEL, fd, NULL);
+		curl_multi_assign(pMulti->pMulti, fd, NULL);
+		return 0;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.data.fd = fd;
+
+	if (what & CURL_POLL_IN)
+		event.events |= EPOLLIN;
+	if (what & CURL_POLL_OUT)
+		event.events |= EPOLLOUT;
+
+	if (pSocket)
+	{
+		res = epoll_ctl(pMulti->fdEpoll, EPOLL_CTL_MOD, fd, &event);
+	} else {
+		res = epoll_ctl(pMulti->fdEpoll, EPOLL_CTL_ADD, fd, &event);
+		curl_multi_assign(pMulti->pMulti, fd, pMulti);
+	}
+
+	if (res)
+		errLog(-1, "could not update socket %d in epoll: %s", fd, strerror(errno));
+
+	return 0;
+}
+
+// Called by libcurl. Mutex of the multi handle is held
+int HttpRequesting::curlTimerCb(CURLM *pCurlMulti, long timeoutMs, void *pUser)
+{
+	HttpMulti *pMulti = (HttpMulti *)pUser;
+
+	(void)pCurlMulti;
+
+	if (timeoutMs < 0)
+	{
+		pMulti->deadlineSet = false;
+		return 0;
+	}
+
+	pMulti->tDeadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+	pMulti->deadlineSet = true;
+
+	if (pMulti == &multiGlobal && fdEngineWake >= 0 &&
+			this_thread::get_id() != idEngine)
+		eventfd_write(fdEngineWake, 1);
+
+	return 0;
+}
+#endif
+
+/*
+ * Literature
+ * - https://curl.se/libcurl/c/curl_easy_reset.html
+ * - https://everything.curl.dev/transfers/conn/reuse.html
+ */
+CURL *HttpRequesting::easyHandleBorrow(const string &key)
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mtxEasyPool);
+#endif
+	list<HttpEasyIdle>::iterator iter;
+	CURL *pCurl;
+
+	for (iter = easyPool.begin(); iter != easyPool.end(); ++iter)
+	{
+		if (iter->key != key)
+			continue;
+
+		pCurl = iter->pCurl;
+		easyPool.erase(iter);
+
+		return pCurl;
+	}
+
+	return curl_easy_init();
+}
+
+void HttpRequesting::easyHandleReturn(const string &key, CURL *pCurl)
+{
 #if CONFIG_PROC_HAVE_DRIVERS
-	Guard lock(mtxCurlMulti);
+	Guard lock(mtxEasyPool);
 #endif
-	if (!pCurlMulti)
+	if (!pCurl)
+		return;
+
+	if (!easyPoolDeInitRegistered)
+	{
+		Processing::globalDestructorRegister(easyPoolDeInit);
+		easyPoolDeInitRegistered = true;
+	}
+
+	// Keeps live connections and the TLS session cache
+	curl_easy_reset(pCurl);
+
+	easyPool.push_front({key, pCurl});
+
+	if (easyPool.size() <= cNumEasyIdleMax)
+		return;
+
+	curl_easy_cleanup(easyPool.back().pCurl);
+	easyPool.pop_back();
+}
+
+void HttpRequesting::easyPoolDeInit()
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(mtxEasyPool);
+#endif
+	list<HttpEasyIdle>::iterator iter;
+
+	for (iter = easyPool.begin(); iter != easyPool.end(); ++iter)
+		curl_easy_cleanup(iter->pCurl);
+
+	easyPool.clear();
+}
+
+/*
+ * Idle sessions expire after cMsSessionIdleMax.
+ * When forced, the oldest idle session is removed
+ * to make room for a new one
+ */
+void HttpRequesting::sessionsIdleRemove(uint32_t curTimeMs, bool force)
+{
+	list<HttpSession>::iterator iter, iterOldest;
+	uint32_t diffMs, diffMsOldest = 0;
+
+	iterOldest = sessions.end();
+	iter = sessions.begin();
+
+	while (iter != sessions.end())
+	{
+		if (iter->numReferences)
+		{
+			++iter;
+			continue;
+		}
+
+		diffMs = curTimeMs - iter->msIdleStart;
+
+		if (diffMs < cMsSessionIdleMax)
+		{
+			if (iterOldest == sessions.end() || diffMs > diffMsOldest)
+			{
+				iterOldest = iter;
+				diffMsOldest = diffMs;
+			}
+
+			++iter;
+			continue;
+		}
+
+		curl_share_cleanup(iter->pCurlShare);
+		iter = sessions.erase(iter);
+	}
+
+	if (!force || iterOldest == sessions.end())
 		return;
 
-	curl_multi_cleanup(pCurlMulti);
-	pCurlMulti = NULL;
+	curl_share_cleanup(iterOldest->pCurlShare);
+	sessions.erase(iterOldest);
+}
+
+void HttpRequesting::sessionsDeInit()
+{
+#if CONFIG_PROC_HAVE_DRIVERS
+	Guard lock(sessionMtx);
+#endif
+	list<HttpSession>::iterator iter;
+
+	for (iter = sessions.begin(); iter != sessions.end(); ++iter)
+		curl_share_cleanup(iter->pCurlShare);
 
-	dbgLog("global deinit curl multi done");
+	sessions.clear();
 }
 
+/*
+ * Literature
+ * - https://curl.se/libcurl/c/CURLSHOPT_LOCKFUNC.html
+ * - https://curl.se/libcurl/c/CURLSHOPT_UNLOCKFUNC.html
+ */
 extern "C" void HttpRequesting::sharedDataLock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
 {
-	int dataIdx = data - 1;
+	HttpSession *pSession = (HttpSession *)userptr;
 
 	(void)handle;
-	(void)access;
 
-	if (dataIdx < numSharedDataTypes)
-		(*((vector<mutex *> *)userptr))[dataIdx]->lock();
-	else
-		cerr << "curl shared data lock: dataIdx(" << dataIdx << ") >= numSharedDataTypes(4)" << endl;
+	if (data >= CURL_LOCK_DATA_LAST)
+	{
+		errLog(-1, "curl shared data lock: data type %d unknown", data);
+		return;
+	}
+
+	if (access == CURL_LOCK_ACCESS_SHARED)
+	{
+		pSession->mtxData[data].lock_shared();
+		return;
+	}
+
+	pSession->mtxData[data].lock();
+	pSession->lockedExclusive[data] = true;
 }
 
 extern "C" void HttpRequesting::sharedDataUnLock(CURL *handle, curl_lock_data data, void *userptr)
 {
-	int dataIdx = data - 1;
+	HttpSession *pSession = (HttpSession *)userptr;
 
 	(void)handle;
 
-	if (dataIdx < numSharedDataTypes)
-		(*((vector<mutex *> *)userptr))[dataIdx]->unlock();
-	else
-		cerr << "curl shared data unlock: dataIdx(" << dataIdx << ") >= numSharedDataTypes(4)" << endl;
+	if (data >= CURL_LOCK_DATA_LAST)
+	{
+		errLog(-1, "curl shared data unlock: data type %d unknown", data);
+		return;
+	}
+
+	// Only set while locked exclusively. Readers always see false
+	if (pSession->lockedExclusive[data])
+	{
+		pSession->lockedExclusive[data] = false;
+		pSession->mtxData[data].unlock();
+		return;
+	}
+
+	pSession->mtxData[data].unlock_shared();
 }
 
 extern "C" size_t HttpRequesting::curlDataToStringWrite(void *ptr, size_t size, size_t nmemb, string *pData)
@@ -970,6 +1659,64 @@ extern "C" size_t HttpRequesting::curlDataToByteVecWrite(void *ptr, size_t size,
 	return sz;
 }
 
+/*
+ * Chunks delivered again after a pause start at the same
+ * byte. mLenSinkDone skips the part already written to fd
+ */
+extern "C" size_t HttpRequesting::curlDataToSinkWrite(void *ptr, size_t size, size_t nmemb, HttpRequesting *pReq)
+{
+	size_t sz = size * nmemb;
+	const uint8_t *pData = (const uint8_t *)ptr;
+	ssize_t res;
+
+	if (pReq->mpFctSink)
+	{
+		if (pReq->mpFctSink(pData, sz, pReq->mpUserSink))
+			return sz;
+
+		pReq->mSinkPaused = true;
+		return CURL_WRITEFUNC_PAUSE;
+	}
+
+	if (pReq->mpTransSink)
+	{
+		if (!pReq->mpTransSink->mSendReady)
+		{
+			pReq->mSinkPaused = true;
+			return CURL_WRITEFUNC_PAUSE;
+		}
+
+		pReq->mpTransSink->send(pData, sz);
+		return sz;
+	}
+
+	while (pReq->mLenSinkDone < sz)
+	{
+		res = ::write(pReq->mFdSink, pData + pReq->mLenSinkDone, sz - pReq->mLenSinkDone);
+		if (res >= 0)
+		{
+			pReq->mLenSinkDone += res;
+			continue;
+		}
+
+		if (errno == EINTR)
+			continue;
+
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+		{
+			pReq->mSinkPaused = true;
+			return CURL_WRITEFUNC_PAUSE;
+		}
+
+		errLog(-1, "could not write to sink: %s", strerror(errno));
+		return 0;
+	}
+
+	pReq->mLenSinkDone = 0;
+
+	return sz;
+}
+
 extern "C" int HttpRequesting::curlTrace(CURL *pCurl, curl_infotype type, char *pData, size_t size, void *pUser)
 {
 	int typeInt = (int)type;
@@ -29,27 +29,56 @@
 #include <string>
 #include <list>
 #include <vector>
+#include <atomic>
+#include <shared_mutex>
 
 #include "Processing.h"
 #if CONFIG_LIB_DSPC_HAVE_C_ARES
 #include "DnsResolving.h"
 #endif
 #include "LibDspc.h"
+#include "Transfering.h"
+
+#if defined(__linux__) && CONFIG_PROC_HAVE_DRIVERS
+#define dHttpEngineEpoll		1
+#include <thread>
+#include <chrono>
+struct epoll_event;
+#endif
 
-#define numSharedDataTypes		4
 #define dHttpDefaultTimeoutMs		2700
 
 #define dHttpResponseCodeOk		200
 
+// Return false to pause the transfer. Chunk is delivered again
+typedef bool (*FuncHttpSink)(const uint8_t *pData, size_t len, void *pUser);
+
 struct HttpSession
 {
 	size_t numReferences;
 	size_t maxReferences;
-	std::string address;
-	uint16_t port;
-	CURL *pCurlShare;
-	std::vector<std::mutex *> sharedDataMtxList;
-	std::vector<std::mutex *> sslMtxList;
+	uint32_t msIdleStart;
+	std::string key;
+	CURLSH *pCurlShare;
+	std::shared_mutex mtxData[CURL_LOCK_DATA_LAST];
+	std::atomic<bool> lockedExclusive[CURL_LOCK_DATA_LAST];
+};
+
+struct HttpEasyIdle
+{
+	std::string key;
+	CURL *pCurl;
+};
+
+struct HttpMulti
+{
+	std::mutex mtx;
+	CURLM *pMulti = NULL;
+#if dHttpEngineEpoll
+	int fdEpoll = -1;
+	bool deadlineSet = false;
+	std::chrono::steady_clock::time_point tDeadline;
+#endif
 };
 
 class HttpRequesting : public Processing
@@ -78,9 +107,17 @@ public:
 	void versionTlsSet(const std::string &versionTls);
 	void versionHttpSet(const std::string &versionHttp);
 	void modeDebugSet(bool en);
+	void sessionShareSet(bool en);
 
 	CURL *easyHandleCurl();
 
+	static void multiPerThreadSet(bool en);
+
+	// streaming output
+	void sinkSet(FuncHttpSink pFctSink, void *pUser = NULL);
+	void sinkSet(int fd, bool autoClose = false);
+	void sinkSet(Transfering *pTrans);
+
 	// output
 	uint16_t respCode() const;
 	std::string &respHdr();
@@ -108,13 +145,14 @@ private:
 	Success shutdown();
 	void processInfo(char *pBuf, char *pBufEnd);
 
+	std::string easyHandleKey() const;
 	Success easyHandleCurlConfigure();
 	Success easyHandleCurlBind();
-	CURLM *multiHandleCurlInit();
 	void easyHandleCurlUnbind();
-	Success sessionCreate(const std::string &address, const uint16_t port);
+	Success sessionCreate(const std::string &key);
 	void sessionTerminate();
-	void sharedDataMtxListDelete();
+	bool sinkUsed() const;
+	void sinkResume();
 
 	/* member variables */
 	uint32_t mStateSd;
@@ -135,10 +173,12 @@ private:
 	std::string mVersionTls;
 	std::string mVersionHttp;
 	bool mModeDebug;
+	bool mSessionShare;
 #if CONFIG_LIB_DSPC_HAVE_C_ARES
 	DnsResolving *mpResolv;
 #endif
 	CURL *mpCurl;
+	HttpMulti *mpMulti;
 	bool mCurlBound;
 	struct curl_slist *mpListHeader;
 	struct curl_slist *mpListResolv;
@@ -148,28 +188,81 @@ private:
 	std::string mRespHdr;
 	std::vector<uint8_t> mRespData;
 
+	FuncHttpSink mpFctSink;
+	void *mpUserSink;
+	int mFdSink;
+	bool mFdSinkAutoClose;
+	Transfering *mpTransSink;
+	size_t mLenSinkDone;
+	std::atomic<bool> mSinkPaused;
+
 	std::list<HttpSession>::iterator mSession;
+	bool mSessionRef;
 #if 0 // TODO: Implement
 	uint8_t mRetries;
 #endif
-	Success mDoneCurl;
+	std::atomic<Success> mDoneCurl;
 
 	/* static functions */
-	static void multiProcess();
+	static HttpMulti *multiGet();
+	static bool multiInit(HttpMulti *pMulti);
+	static void multiDeInit(HttpMulti *pMulti);
+	static void multiProcess(HttpMulti *pMulti);
+	static void multiDoneCheck(HttpMulti *pMulti);
 	static void curlMultiDeInit();
+	static CURL *easyHandleBorrow(const std::string &key);
+	static void easyHandleReturn(const std::string &key, CURL *pCurl);
+	static void easyPoolDeInit();
+	static void sessionsIdleRemove(uint32_t curTimeMs, bool force);
+	static void sessionsDeInit();
+#if dHttpEngineEpoll
+	static void multiSocketsDrive(HttpMulti *pMulti, struct epoll_event *pEvents, int numEvents);
+	static int multiTimeoutGet(HttpMulti *pMulti);
+	static bool engineStart();
+	static void engineStop();
+	static void engineRun();
+	static int curlSocketCb(CURL *pCurl, curl_socket_t fd, int what, void *pUser, void *pSocket);
+	static int curlTimerCb(CURLM *pMulti, long timeoutMs, void *pUser);
+#endif
 	static void sharedDataLock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr);
 	static void sharedDataUnLock(CURL *handle, curl_lock_data data, void *userptr);
 	static size_t curlDataToStringWrite(void *ptr, size_t size, size_t nmemb, std::string *pData);
 	static size_t curlDataToByteVecWrite(void *ptr, size_t size, size_t nmemb, std::vector<uint8_t> *pData);
+	static size_t curlDataToSinkWrite(void *ptr, size_t size, size_t nmemb, HttpRequesting *pReq);
 	static int curlTrace(CURL *pCurl, curl_infotype type, char *pData, size_t size, void *pUser);
 	static void curlListFree(struct curl_slist **ppList);
 
 	/* static variables */
-	static std::mutex mtxCurlMulti;
-	static CURLM *pCurlMulti;
+	static HttpMulti multiGlobal;
+	static std::atomic<bool> multiDeInitRegistered;
+#if dHttpEngineEpoll
+	static std::thread *pThdEngine;
+	static std::thread::id idEngine;
+	static std::atomic<bool> engineActive;
+	static std::atomic<bool> engineStopReq;
+	static int fdEngineWake;
+#endif
+#if CONFIG_PROC_HAVE_DRIVERS
+	struct MultiLocal
+	{
+		HttpMulti *pMulti = NULL;
+		~MultiLocal();
+	};
+
+	static std::atomic<bool> multiPerThread;
+	static std::mutex mtxMultisLocal;
+	static std::list<HttpMulti> multisLocal;
+	static std::list<HttpMulti *> multisLocalFree;
+	static thread_local MultiLocal multiLocal;
+#endif
 
 	static std::mutex sessionMtx;
 	static std::list<HttpSession> sessions;
+	static bool sessionsDeInitRegistered;
+
+	static std::mutex mtxEasyPool;
+	static std::list<HttpEasyIdle> easyPool;
+	static bool easyPoolDeInitRegistered;
 
 	/* constants */
 
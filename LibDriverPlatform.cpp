@@ -31,6 +31,18 @@
  */
 #if defined(__linux__) || defined(__APPLE__)
 #include <pthread.h>
+#include <sched.h>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <cerrno>
+#endif
 #elif defined(_WIN32)
 #include <windows.h>
 #else
@@ -49,6 +61,13 @@ struct DriverPlatform
 {
 #if defined(__linux__) || defined(__APPLE__)
 	pthread_t pthread;
+	char nameInitial[16];
+	std::mutex mtxWork;
+	std::condition_variable condWork;
+	bool assigned;
+	bool done;
+	bool parked;
+	bool exitReq;
 #elif defined(_WIN32)
 	HANDLE hThread;
 	DWORD idThread;
@@ -61,12 +80,56 @@ struct DriverPlatform
 // class ConfigDriver
 
 size_t ConfigDriver::sizeStackDefault = 16384;
+size_t ConfigDriver::driversIdleMax = 16;
 
 void ConfigDriver::sizeStackDefaultSet(size_t sizeStack)
 {
 	sizeStackDefault = sizeStack;
 }
 
+void ConfigDriver::driversIdleMaxSet(size_t numMax)
+{
+	driversIdleMax = numMax;
+}
+
+size_t ConfigDriver::driversIdleMaxGet()
+{
+	return driversIdleMax;
+}
+
+/*
+ * Thread names are limited to 15 characters on Linux.
+ * Keep the end of the name since process names often
+ * share a common prefix.
+ */
+const size_t cLenNameThreadMax = 15;
+
+void ConfigDriver::nameSet(const char *pName)
+{
+	size_t len;
+
+	if (!pName)
+	{
+		mName = "";
+		return;
+	}
+
+	len = strlen(pName);
+	if (len > cLenNameThreadMax)
+		pName += len - cLenNameThreadMax;
+
+	mName = pName;
+}
+
+bool ConfigDriver::schedEqual(const ConfigDriver &config) const
+{
+	return mSizeStack == config.mSizeStack &&
+		mMaskAffinity == config.mMaskAffinity &&
+		mPolicySched == config.mPolicySched &&
+		mPrioSched == config.mPrioSched &&
+		mNice == config.mNice;
+}
+
 // Platform code
 
 /*
@@ -75,12 +138,212 @@ void ConfigDriver::sizeStackDefaultSet(size_t sizeStack)
  * - https://man7.org/linux/man-pages/man3/pthread_join.3.html
  * - https://man7.org/linux/man-pages/man3/pthread_attr_init.3.html
  * - https://man7.org/linux/man-pages/man3/pthread_attr_setstacksize.3.html
+ * - https://man7.org/linux/man-pages/man3/pthread_setname_np.3.html
+ * - https://man7.org/linux/man-pages/man2/sched_setaffinity.2.html
+ * - https://man7.org/linux/man-pages/man7/sched.7.html
+ * - https://man7.org/linux/man-pages/man2/setpriority.2.html
  */
 #if defined(__linux__) || defined(__APPLE__)
+/*
+ * Parked driver threads
+ *
+ * Threads are detached. After the drive function returned and
+ * the driver has been cleaned up, the thread is parked for reuse
+ * together with its stack. A new driver with the same stack size
+ * and scheduling settings takes over a parked thread instead of
+ * creating a new one. Threads parked for too long exit by themselves.
+ */
+const uint32_t cMsDriverParkedMax = 10000;
+
+static mutex mtxDriversIdle;
+// Never freed. Parked threads may outlive static destruction
+static vector<DriverPlatform *> *pDriversIdle = NULL;
+
+static DriverPlatform *driverIdleGet(const ConfigDriver &config)
+{
+	vector<DriverPlatform *>::iterator iter;
+	DriverPlatform *pDrv;
+	Guard lock(mtxDriversIdle);
+
+	if (!pDriversIdle)
+		return NULL;
+
+	iter = pDriversIdle->begin();
+	for (; iter != pDriversIdle->end(); ++iter)
+	{
+		pDrv = *iter;
+
+		if (!pDrv->config.schedEqual(config))
+			continue;
+
+		pDriversIdle->erase(iter);
+		pDrv->parked = false;
+
+		return pDrv;
+	}
+
+	return NULL;
+}
+
+// Executed by the driver thread
+static bool driverAssignedWait(DriverPlatform *pDrv)
+{
+	unique_lock<mutex> lock(pDrv->mtxWork);
+
+	while (!pDrv->assigned && !pDrv->exitReq)
+	{
+		if (pDrv->condWork.wait_for(lock,
+				chrono::milliseconds(cMsDriverParkedMax)) == cv_status::no_timeout)
+			continue;
+
+		lock.unlock();
+
+		{
+			Guard lockIdle(mtxDriversIdle);
+
+			if (pDrv->parked)
+			{
+				pDriversIdle->erase(find(pDriversIdle->begin(), pDriversIdle->end(), pDrv));
+				pDrv->parked = false;
+				pDrv->exitReq = true;
+			}
+		}
+
+		lock.lock();
+	}
+
+	if (pDrv->exitReq)
+		return false;
+
+	pDrv->assigned = false;
+
+	return true;
+}
+
+// Executed by the driver thread
+static void nameApply(DriverPlatform *pDrv)
+{
+	const char *pName = pDrv->config.mName.c_str();
+	int res;
+
+	if (!*pName)
+		pName = pDrv->nameInitial;
+#if defined(__APPLE__)
+	res = pthread_setname_np(pName);
+#else
+	res = pthread_setname_np(pthread_self(), pName);
+#endif
+	if (res)
+		errLog(-1, "could not set thread name: %s (%d)", strerror(res), res);
+}
+
+// Executed by the driver thread. Once per thread, see schedEqual()
+static void schedApply(const ConfigDriver &config)
+{
+	struct sched_param param;
+	int policy;
+	int res;
+
+	if (config.mMaskAffinity)
+	{
+#if defined(__linux__)
+		cpu_set_t setCpu;
+
+		CPU_ZERO(&setCpu);
+
+		for (int idCpu = 0; idCpu < 64; ++idCpu)
+		{
+			if (config.mMaskAffinity & (((uint64_t)1) << idCpu))
+				CPU_SET(idCpu, &setCpu);
+		}
+
+		res = pthread_setaffinity_np(pthread_self(), sizeof(setCpu), &setCpu);
+		if (res)
+			errLog(-1, "could not set CPU affinity: %s (%d)", strerror(res), res);
+#else
+		errLog(-1, "CPU affinity not supported on this platform");
+#endif
+	}
+
+	if (config.mPolicySched == SchedInherit)
+		return;
+
+	switch (config.mPolicySched)
+	{
+	case SchedFifo:
+		policy = SCHED_FIFO;
+		break;
+	case SchedRr:
+		policy = SCHED_RR;
+		break;
+#if defined(__linux__)
+	case SchedIdle:
+		policy = SCHED_IDLE;
+		break;
+#endif
+	case SchedOther:
+		policy = SCHED_OTHER;
+		break;
+	default:
+		errLog(-1, "scheduling policy not supported on this platform");
+		return;
+	}
+
+	memset(&param, 0, sizeof(param));
+
+	if (policy == SCHED_FIFO || policy == SCHED_RR)
+		param.sched_priority = config.mPrioSched;
+
+	res = pthread_setschedparam(pthread_self(), policy, &param);
+	if (res)
+	{
+		errLog(-1, "could not set scheduling policy: %s (%d)", strerror(res), res);
+		return;
+	}
+
+	if (policy == SCHED_FIFO || policy == SCHED_RR)
+		return;
+#if defined(__linux__)
+	// Linux: Nice value is a per-thread attribute
+	res = setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), config.mNice);
+	if (res)
+		errLog(-1, "could not set nice value: %s (%d)", strerror(errno), errno);
+#else
+	if (config.mNice)
+		errLog(-1, "nice value per thread not supported on this platform");
+#endif
+}
+
 void *threadExecute(void *pData)
 {
 	DriverPlatform *pDrv = (DriverPlatform *)pData;
-	pDrv->pFctDrive(pDrv->pProc);
+	bool schedApplied = false;
+	int res;
+
+	res = pthread_getname_np(pthread_self(),
+				pDrv->nameInitial, sizeof(pDrv->nameInitial));
+	if (res)
+		pDrv->nameInitial[0] = 0;
+
+	while (driverAssignedWait(pDrv))
+	{
+		if (!schedApplied)
+		{
+			schedApply(pDrv->config);
+			schedApplied = true;
+		}
+
+		nameApply(pDrv);
+
+		pDrv->pFctDrive(pDrv->pProc);
+
+		Guard lock(pDrv->mtxWork);
+		pDrv->done = true;
+		pDrv->condWork.notify_all();
+	}
+
+	delete pDrv;
+
 	return NULL;
 }
 
@@ -94,6 +357,25 @@ void *driverPlatformCreate(FuncInternalDrive pFctDrive, void *pProc, void *pConf
 	DriverPlatform *pDrv = NULL;
 	int res;
 
+	if (pConfigDriver)
+		pConfig = (ConfigDriver *)pConfigDriver;
+
+	pDrv = driverIdleGet(*pConfig);
+	if (pDrv)
+	{
+		Guard lock(pDrv->mtxWork);
+
+		pDrv->config = *pConfig;
+		pDrv->pFctDrive = pFctDrive;
+		pDrv->pProc = pProc;
+		pDrv->assigned = true;
+		pDrv->done = false;
+
+		pDrv->condWork.notify_one();
+
+		return pDrv;
+	}
+
 	res = pthread_attr_init(&attrThread);
 	if (res)
 	{
@@ -101,9 +383,6 @@ void *driverPlatformCreate(FuncInternalDrive pFctDrive, void *pProc, void *pConf
 		return NULL;
 	}
 
-	if (pConfigDriver)
-		pConfig = (ConfigDriver *)pConfigDriver;
-
 	res = pthread_attr_setstacksize(&attrThread, pConfig->mSizeStack);
 	if (res)
 	{
@@ -111,6 +390,13 @@ void *driverPlatformCreate(FuncInternalDrive pFctDrive, void *pProc, void *pConf
 		goto drvExit;
 	}
 
+	res = pthread_attr_setdetachstate(&attrThread, PTHREAD_CREATE_DETACHED);
+	if (res)
+	{
+		errLog(-1, "could not set detach state: %s (%d)", strerror(res), res);
+		goto drvExit;
+	}
+
 	pDrv = new dNoThrow DriverPlatform;
 	if (!pDrv)
 	{
@@ -121,6 +407,10 @@ void *driverPlatformCreate(FuncInternalDrive pFctDrive, void *pProc, void *pConf
 	pDrv->config = *pConfig;
 	pDrv->pFctDrive = pFctDrive;
 	pDrv->pProc = pProc;
+	pDrv->assigned = true;
+	pDrv->done = false;
+	pDrv->parked = false;
+	pDrv->exitReq = false;
 
 	res = pthread_create(&pDrv->pthread, &attrThread, threadExecute, pDrv);
 	if (res)
@@ -144,13 +434,31 @@ void driverPlatformCleanUp(void *pDriver)
 	//wrnLog("REMOVE_ME: cleaning up custom driver");
 
 	DriverPlatform *pDrv = (DriverPlatform *)pDriver;
+	unique_lock<mutex> lock(pDrv->mtxWork);
 
-	int res = pthread_join(pDrv->pthread, NULL);
-	if (res)
-		errLog(-1, "could not join pthread: %s (%d)", strerror(res), res);
+	pDrv->condWork.wait(lock, [pDrv] { return pDrv->done; });
 
-	delete pDrv;
-	pDrv = NULL;
+	lock.unlock();
+
+	{
+		Guard lockIdle(mtxDriversIdle);
+
+		if (!pDriversIdle)
+			pDriversIdle = new dNoThrow vector<DriverPlatform *>;
+
+		if (pDriversIdle &&
+				pDriversIdle->size() < ConfigDriver::driversIdleMaxGet())
+		{
+			pDrv->parked = true;
+			pDriversIdle->push_back(pDrv);
+			return;
+		}
+	}
+
+	// Thread deletes the driver. Not referenced afterwards
+	lock.lock();
+	pDrv->exitReq = true;
+	pDrv->condWork.notify_one();
 }
 
 /*
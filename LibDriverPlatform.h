@@ -26,21 +26,48 @@
 #ifndef LIB_DRIVER_PLATFORM_H
 #define LIB_DRIVER_PLATFORM_H
 
+#include <string>
+
 #include "Processing.h"
 
+enum DriverSchedPolicy
+{
+	SchedInherit = 0,
+	SchedOther,
+	SchedFifo,
+	SchedRr,
+	SchedIdle,
+};
+
 class ConfigDriver
 {
 public:
 	ConfigDriver()
 		: mSizeStack(sizeStackDefault)
+		, mName("")
+		, mMaskAffinity(0)
+		, mPolicySched(SchedInherit)
+		, mPrioSched(0)
+		, mNice(0)
 	{}
 
 	static void sizeStackDefaultSet(size_t sizeStack);
+	static void driversIdleMaxSet(size_t numMax);
+	static size_t driversIdleMaxGet();
+
+	void nameSet(const char *pName);
+	bool schedEqual(const ConfigDriver &config) const;
 
 	size_t mSizeStack;
+	std::string mName;
+	uint64_t mMaskAffinity;
+	DriverSchedPolicy mPolicySched;
+	int mPrioSched;
+	int mNice;
 
 private:
 	static size_t sizeStackDefault;
+	static size_t driversIdleMax;
 };
 
 void *driverPlatformCreate(FuncInternalDrive pFctDrive, void *pProc, void *pConfigDriver);
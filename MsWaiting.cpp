@@ -24,6 +24,7 @@
 */
 
 #include "MsWaiting.h"
+#include "ThreadPooling.h"
 #include "LibTime.h"
 
 #define dForEach_ProcState(gen) \
@@ -44,17 +45,22 @@ MsWaiting::MsWaiting(uint32_t durationMs)
 	: Processing("MsWaiting")
 	, mStartMs(0)
 	, mDurationMs(durationMs)
-	, mDiffMs(0)
+	, mTimer()
 {
 	mState = StStart;
 }
 
+MsWaiting::~MsWaiting()
+{
+	TimerWheel::timerCancel(&mTimer);
+}
+
 /* member functions */
 
 Success MsWaiting::process()
 {
-	uint32_t curTimeMs = millis();
-	uint32_t diffMs = curTimeMs - mStartMs;
+	//uint32_t curTimeMs = millis();
+	//uint32_t diffMs = curTimeMs - mStartMs;
 	//Success success;
 #if 0
 	dStateTrace;
@@ -63,16 +69,21 @@ Success MsWaiting::process()
 	{
 	case StStart:
 
-		mStartMs = curTimeMs;
+		mStartMs = millis();
+		TimerWheel::timerStart(&mTimer, mDurationMs);
+
 		mState = StMain;
 
 		break;
 	case StMain:
 
-		mDiffMs = diffMs;
-
-		if (diffMs < mDurationMs)
+		// No clock read. Woken by the timer wheel
+		if (!TimerWheel::timerExpired(&mTimer))
+		{
+			// Pooled waiters aren't ticked until the deadline
+			ThreadPooling::wakeupSet(this, mTimer.deadlineMs);
 			break;
+		}
 
 		return Positive;
 
@@ -86,9 +97,13 @@ Success MsWaiting::process()
 
 void MsWaiting::processInfo(char *pBuf, char *pBufEnd)
 {
+	uint32_t diffMs = 0;
+
+	if (mState == StMain)
+		diffMs = PMIN(millis() - mStartMs, mDurationMs);
 #if 1
 	//dInfo("State\t\t\t%s\n", ProcStateString[mState]);
-	progressStr(pBuf, pBufEnd, mDiffMs, mDurationMs);
+	progressStr(pBuf, pBufEnd, diffMs, mDurationMs);
 #endif
 }
 
@@ -27,6 +27,7 @@
 #define MS_WAITING_H
 
 #include "Processing.h"
+#include "TimerWheel.h"
 
 class MsWaiting : public Processing
 {
@@ -40,7 +41,7 @@ public:
 
 protected:
 
-	virtual ~MsWaiting() {}
+	virtual ~MsWaiting();
 
 private:
 
@@ -61,7 +62,7 @@ private:
 	/* member variables */
 	uint32_t mStartMs;
 	uint32_t mDurationMs;
-	uint32_t mDiffMs;
+	WheelTimer mTimer;
 
 	/* static functions */
 
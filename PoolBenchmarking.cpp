@@ -0,0 +1,470 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 17.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "PoolBenchmarking.h"
+#include "LibTime.h"
+
+#define dForEach_ProcState(gen) \
+		gen(StStart) \
+		gen(StRunStart) \
+		gen(StPoolSettle) \
+		gen(StProcsSubmit) \
+		gen(StProcsDoneWait) \
+		gen(StPoolDoneWait) \
+
+#define dGenProcStateEnum(s) s,
+dProcessStateEnum(ProcState);
+
+#if 1
+#define dGenProcStateString(s) #s,
+dProcessStateStr(ProcState);
+#endif
+
+using namespace std;
+using namespace chrono;
+
+static const char *cNamePoolBench = "PoolBenchmarking";
+const uint32_t cNumProcsDefault = 1000;
+const uint32_t cMsPoolSettle = 200;
+const uint32_t cMsRunTimeout = 60000;
+const uint32_t cNumTicksLongLived = 200;
+const uint32_t cNumTicksCpuHeavy = 20;
+const uint32_t cUsTickCpuHeavy = 50;
+const uint32_t cMsYieldHeavy = 20;
+
+/*
+ * Synthetic process driven by the benchmarked pool
+ *
+ * The load of a workload is defined by the number of ticks and
+ * by the time spent in each tick. Ticks are accounted per thread
+ * since a process may be stolen or migrated.
+ */
+class PoolBenchProc : public Processing
+{
+
+public:
+
+	static PoolBenchProc *create(PoolBenchmarking *pBench, PoolBenchWorkload workload)
+	{
+		return new dNoThrow PoolBenchProc(pBench, workload);
+	}
+
+	steady_clock::time_point mTpSubmit;
+	steady_clock::time_point mTpFirstTick;
+	steady_clock::time_point mTpFinish;
+
+protected:
+
+	virtual ~PoolBenchProc() {}
+
+private:
+
+	PoolBenchProc() = delete;
+	PoolBenchProc(PoolBenchmarking *pBench, PoolBenchWorkload workload)
+		: Processing("PoolBenchProc")
+		, mTpSubmit()
+		, mTpFirstTick()
+		, mTpFinish()
+		, mpBench(pBench)
+		, mWorkload(workload)
+		, mTicked(false)
+		, mIdThread()
+		, mNumTicksThread(0)
+		, mNumTicks(0)
+	{}
+	PoolBenchProc(const PoolBenchProc &) = delete;
+	PoolBenchProc &operator=(const PoolBenchProc &) = delete;
+
+	/* member functions */
+	Success process()
+	{
+		steady_clock::time_point tpNow = steady_clock::now();
+		thread::id idThread = this_thread::get_id();
+		bool finished = false;
+
+		if (!mTicked)
+		{
+			mTicked = true;
+			mTpFirstTick = tpNow;
+			mIdThread = idThread;
+		}
+
+		if (idThread != mIdThread)
+		{
+			mpBench->ticksRecord(mIdThread, mNumTicksThread);
+			mNumTicksThread = 0;
+			mIdThread = idThread;
+		}
+
+		++mNumTicksThread;
+		++mNumTicks;
+
+		switch (mWorkload)
+		{
+		case BenchShortLived:
+			finished = true;
+			break;
+		case BenchLongLived:
+			finished = mNumTicks >= cNumTicksLongLived;
+			break;
+		case BenchCpuHeavy:
+			while (steady_clock::now() - tpNow < microseconds(cUsTickCpuHeavy))
+				;
+			finished = mNumTicks >= cNumTicksCpuHeavy;
+			break;
+		case BenchYieldHeavy:
+			finished = tpNow - mTpFirstTick >= milliseconds(cMsYieldHeavy);
+			break;
+		default:
+			finished = true;
+			break;
+		}
+
+		if (!finished)
+			return Pending;
+
+		mpBench->ticksRecord(mIdThread, mNumTicksThread);
+		mTpFinish = steady_clock::now();
+
+		// Must be last. Parent evaluates the process afterwards
+		++mpBench->mNumDone;
+
+		return Positive;
+	}
+
+	/* member variables */
+	PoolBenchmarking *mpBench;
+	PoolBenchWorkload mWorkload;
+	bool mTicked;
+	thread::id mIdThread;
+	uint32_t mNumTicksThread;
+	uint32_t mNumTicks;
+
+};
+
+PoolBenchmarking::PoolBenchmarking()
+	: Processing("PoolBenchmarking")
+	, mStartMs(0)
+	, mVecCntWorkers()
+	, mVecWorkloads()
+	, mNumProcs(cNumProcsDefault)
+	, mIdxRun(0)
+	, mpPool(NULL)
+	, mVecProcs()
+	, mTpSubmit()
+	, mTpDone()
+	, mNumDone(0)
+	, mMtxTicks()
+	, mTicksPerThread()
+	, mVecResults()
+{
+	mState = StStart;
+}
+
+/* member functions */
+
+void PoolBenchmarking::workerCntAdd(uint16_t cnt)
+{
+	if (!cnt)
+		return;
+
+	mVecCntWorkers.push_back(cnt);
+}
+
+void PoolBenchmarking::workloadAdd(PoolBenchWorkload workload)
+{
+	mVecWorkloads.push_back(workload);
+}
+
+void PoolBenchmarking::numProcsSet(uint32_t numProcs)
+{
+	if (!numProcs)
+		return;
+
+	mNumProcs = numProcs;
+}
+
+const vector<PoolBenchResult> &PoolBenchmarking::resultsGet() const
+{
+	return mVecResults;
+}
+
+Success PoolBenchmarking::process()
+{
+	uint32_t curTimeMs = millis();
+	uint32_t diffMs = curTimeMs - mStartMs;
+	size_t numRuns = mVecCntWorkers.size() * mVecWorkloads.size();
+	bool ok;
+#if 0
+	dStateTrace;
+#endif
+	switch (mState)
+	{
+	case StStart:
+
+		if (!mVecCntWorkers.size())
+		{
+			mVecCntWorkers.push_back(1);
+			mVecCntWorkers.push_back(2);
+			mVecCntWorkers.push_back(4);
+		}
+
+		if (!mVecWorkloads.size())
+		{
+			mVecWorkloads.push_back(BenchShortLived);
+			mVecWorkloads.push_back(BenchLongLived);
+			mVecWorkloads.push_back(BenchCpuHeavy);
+			mVecWorkloads.push_back(BenchYieldHeavy);
+		}
+
+		mState = StRunStart;
+
+		break;
+	case StRunStart:
+
+		if (mIdxRun >= numRuns)
+			return Positive;
+
+		mpPool = ThreadPooling::create(cNamePoolBench);
+		if (!mpPool)
+			return procErrLog(-1, "could not create thread pool");
+
+		mpPool->workerCntSet(mVecCntWorkers[mIdxRun / mVecWorkloads.size()]);
+
+		start(mpPool);
+
+		mStartMs = curTimeMs;
+		mState = StPoolSettle;
+
+		break;
+	case StPoolSettle:
+
+		// Workers are started by the broker
+		if (diffMs < cMsPoolSettle)
+			break;
+
+		mState = StProcsSubmit;
+
+		break;
+	case StProcsSubmit:
+
+		ok = procsSubmit();
+		if (!ok)
+			return procErrLog(-1, "could not submit processes");
+
+		mStartMs = curTimeMs;
+		mState = StProcsDoneWait;
+
+		break;
+	case StProcsDoneWait:
+
+		if (mNumDone < mVecProcs.size())
+		{
+			if (diffMs > cMsRunTimeout)
+				return procErrLog(-1, "timeout waiting for processes");
+			break;
+		}
+
+		resultCreate();
+		procsRepel();
+
+		cancel(mpPool);
+
+		mState = StPoolDoneWait;
+
+		break;
+	case StPoolDoneWait:
+
+		if (!mpPool->shutdownDone())
+			break;
+
+		repel(mpPool);
+		mpPool = NULL;
+
+		++mIdxRun;
+		mState = StRunStart;
+
+		break;
+	default:
+		break;
+	}
+
+	return Pending;
+}
+
+bool PoolBenchmarking::procsSubmit()
+{
+	PoolBenchWorkload workload = mVecWorkloads[mIdxRun % mVecWorkloads.size()];
+	PoolBenchProc *pProc;
+
+	mNumDone = 0;
+	mTicksPerThread.clear();
+	mVecProcs.reserve(mNumProcs);
+
+	mTpSubmit = steady_clock::now();
+
+	for (uint32_t i = 0; i < mNumProcs; ++i)
+	{
+		pProc = PoolBenchProc::create(this, workload);
+		if (!pProc)
+			return false;
+
+		start(pProc, DrivenByExternalDriver);
+		mVecProcs.push_back(pProc);
+
+		pProc->mTpSubmit = steady_clock::now();
+		ThreadPooling::procAdd(mpPool, pProc);
+	}
+
+	return true;
+}
+
+void PoolBenchmarking::procsRepel()
+{
+	vector<PoolBenchProc *>::iterator iter;
+
+	iter = mVecProcs.begin();
+	for (; iter != mVecProcs.end(); ++iter)
+		repel(*iter);
+
+	mVecProcs.clear();
+}
+
+void PoolBenchmarking::resultCreate()
+{
+	vector<PoolBenchProc *>::iterator iter;
+	map<thread::id, uint32_t>::iterator iterTicks;
+	vector<uint32_t> vLatencyUs;
+	PoolBenchResult res;
+	uint64_t durationUs, numTicks = 0, numTicksMax = 0, numTicksMean;
+	size_t numLatencies;
+
+	mTpDone = mTpSubmit;
+	vLatencyUs.reserve(mVecProcs.size());
+
+	iter = mVecProcs.begin();
+	for (; iter != mVecProcs.end(); ++iter)
+	{
+		vLatencyUs.push_back(PMIN(duration_cast<microseconds>(
+				(*iter)->mTpFirstTick - (*iter)->mTpSubmit).count(), UINT32_MAX));
+
+		if ((*iter)->mTpFinish > mTpDone)
+			mTpDone = (*iter)->mTpFinish;
+	}
+
+	sort(vLatencyUs.begin(), vLatencyUs.end());
+	numLatencies = vLatencyUs.size();
+
+	iterTicks = mTicksPerThread.begin();
+	for (; iterTicks != mTicksPerThread.end(); ++iterTicks)
+	{
+		numTicks += iterTicks->second;
+		numTicksMax = PMAX(numTicksMax, (uint64_t)iterTicks->second);
+	}
+
+	durationUs = duration_cast<microseconds>(mTpDone - mTpSubmit).count();
+
+	res.numWorkers = mVecCntWorkers[mIdxRun / mVecWorkloads.size()];
+	res.workload = mVecWorkloads[mIdxRun % mVecWorkloads.size()];
+	res.numProcs = numLatencies;
+	res.durationMs = durationUs / 1000;
+	res.procsPerSec = durationUs ? numLatencies * 1000000 / durationUs : 0;
+
+	res.latencyP50Us = numLatencies ? vLatencyUs[(numLatencies - 1) * 50 / 100] : 0;
+	res.latencyP90Us = numLatencies ? vLatencyUs[(numLatencies - 1) * 90 / 100] : 0;
+	res.latencyP99Us = numLatencies ? vLatencyUs[(numLatencies - 1) * 99 / 100] : 0;
+	res.latencyMaxUs = numLatencies ? vLatencyUs.back() : 0;
+
+	// Workers without any tick count as well
+	numTicksMean = numTicks / res.numWorkers;
+	res.imbalancePercent = numTicksMean ?
+				(numTicksMax - numTicksMean) * 100 / numTicksMean : 0;
+
+	procInfLog("%-12s workers %2u: %7u procs/s, latency p50 %6uus p90 %6uus "
+				"p99 %6uus max %6uus, imbalance %3u%%",
+				workloadStr(res.workload), res.numWorkers, res.procsPerSec,
+				res.latencyP50Us, res.latencyP90Us, res.latencyP99Us,
+				res.latencyMaxUs, res.imbalancePercent);
+
+	mVecResults.push_back(res);
+}
+
+// Executed by the workers of the benchmarked pool
+void PoolBenchmarking::ticksRecord(thread::id idThread, uint32_t numTicks)
+{
+	Guard lock(mMtxTicks);
+	mTicksPerThread[idThread] += numTicks;
+}
+
+void PoolBenchmarking::processInfo(char *pBuf, char *pBufEnd)
+{
+	vector<PoolBenchResult>::iterator iter;
+	size_t numRuns = mVecCntWorkers.size() * mVecWorkloads.size();
+#if 1
+	dInfo("State\t\t\t%s\n", ProcStateString[mState]);
+#endif
+	dInfo("Run\t\t\t%zu/%zu\n", PMIN(mIdxRun + 1, numRuns), numRuns);
+
+	if (mState == StProcsDoneWait)
+		dInfo("Done\t\t\t%u/%zu\n", mNumDone.load(), mVecProcs.size());
+
+	if (!mVecResults.size())
+		return;
+
+	dInfo("Workload      Workers  Procs/s   p50[us]  p90[us]  p99[us]  max[us]  Imbal.\n");
+
+	iter = mVecResults.begin();
+	for (; iter != mVecResults.end(); ++iter)
+	{
+		dInfo("%-12s  %7u  %7u  %8u %8u %8u %8u  %5u%%\n",
+				workloadStr(iter->workload), iter->numWorkers,
+				iter->procsPerSec, iter->latencyP50Us, iter->latencyP90Us,
+				iter->latencyP99Us, iter->latencyMaxUs, iter->imbalancePercent);
+	}
+}
+
+/* static functions */
+
+const char *PoolBenchmarking::workloadStr(PoolBenchWorkload workload)
+{
+	switch (workload)
+	{
+	case BenchShortLived:
+		return "short-lived";
+	case BenchLongLived:
+		return "long-lived";
+	case BenchCpuHeavy:
+		return "cpu-heavy";
+	case BenchYieldHeavy:
+		return "yield-heavy";
+	default:
+		break;
+	}
+
+	return "unknown";
+}
+
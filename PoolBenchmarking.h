@@ -0,0 +1,133 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 17.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POOL_BENCHMARKING_H
+#define POOL_BENCHMARKING_H
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "Processing.h"
+#include "ThreadPooling.h"
+
+enum PoolBenchWorkload
+{
+	BenchShortLived = 0,
+	BenchLongLived,
+	BenchCpuHeavy,
+	BenchYieldHeavy,
+};
+
+struct PoolBenchResult
+{
+	uint16_t numWorkers;
+	PoolBenchWorkload workload;
+	uint32_t numProcs;
+	uint32_t durationMs;
+	uint32_t procsPerSec;
+	uint32_t latencyP50Us;
+	uint32_t latencyP90Us;
+	uint32_t latencyP99Us;
+	uint32_t latencyMaxUs;
+	uint32_t imbalancePercent;
+};
+
+class PoolBenchProc;
+
+class PoolBenchmarking : public Processing
+{
+
+public:
+
+	static PoolBenchmarking *create()
+	{
+		return new dNoThrow PoolBenchmarking;
+	}
+
+	// input
+	void workerCntAdd(uint16_t cnt);
+	void workloadAdd(PoolBenchWorkload workload);
+	void numProcsSet(uint32_t numProcs);
+
+	// output
+	const std::vector<PoolBenchResult> &resultsGet() const;
+
+	static const char *workloadStr(PoolBenchWorkload workload);
+
+protected:
+
+	virtual ~PoolBenchmarking() {}
+
+private:
+
+	friend class PoolBenchProc;
+
+	PoolBenchmarking();
+	PoolBenchmarking(const PoolBenchmarking &) = delete;
+	PoolBenchmarking &operator=(const PoolBenchmarking &) = delete;
+
+	/*
+	 * Naming of functions:  objectVerb()
+	 * Example:              peerAdd()
+	 */
+
+	/* member functions */
+	Success process();
+	void processInfo(char *pBuf, char *pBufEnd);
+
+	bool procsSubmit();
+	void procsRepel();
+	void resultCreate();
+	void ticksRecord(std::thread::id idThread, uint32_t numTicks);
+
+	/* member variables */
+	uint32_t mStartMs;
+	std::vector<uint16_t> mVecCntWorkers;
+	std::vector<PoolBenchWorkload> mVecWorkloads;
+	uint32_t mNumProcs;
+	size_t mIdxRun;
+	ThreadPooling *mpPool;
+	std::vector<PoolBenchProc *> mVecProcs;
+	std::chrono::steady_clock::time_point mTpSubmit;
+	std::chrono::steady_clock::time_point mTpDone;
+	std::atomic<uint32_t> mNumDone;
+	std::mutex mMtxTicks;
+	std::map<std::thread::id, uint32_t> mTicksPerThread;
+	std::vector<PoolBenchResult> mVecResults;
+
+	/* static functions */
+
+	/* static variables */
+
+	/* constants */
+
+};
+
+#endif
+
@@ -0,0 +1,180 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 16.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RING_MPSC_H
+#define RING_MPSC_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+
+/*
+ * Bounded lock-free queue
+ * - Multiple producers
+ * - Single consumer
+ *
+ * Every cell carries a sequence number telling producers
+ * and the consumer whether the cell is free or filled.
+ *
+ * Literature
+ * - https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ * - https://en.cppreference.com/w/cpp/atomic/memory_order
+ */
+template <typename T>
+class RingMpsc
+{
+
+public:
+
+	RingMpsc()
+		: mpCells(NULL)
+		, mMask(0)
+		, mPosEnq(0)
+		, mPosDeq(0)
+	{}
+
+	virtual ~RingMpsc()
+	{
+		delete[] mpCells;
+		mpCells = NULL;
+	}
+
+	bool init(size_t size)
+	{
+		size_t sizeRing = 2;
+
+		if (mpCells)
+			return false;
+
+		while (sizeRing < size)
+			sizeRing <<= 1;
+
+		mpCells = new (std::nothrow) Cell[sizeRing];
+		if (!mpCells)
+			return false;
+
+		for (size_t i = 0; i < sizeRing; ++i)
+			mpCells[i].seq.store(i, std::memory_order_relaxed);
+
+		mMask = sizeRing - 1;
+
+		return true;
+	}
+
+	// Executed by any producer
+	bool push(const T &data)
+	{
+		size_t pos = mPosEnq.load(std::memory_order_relaxed);
+		intptr_t diff;
+		Cell *pCell;
+
+		if (!mpCells)
+			return false;
+
+		while (1)
+		{
+			pCell = &mpCells[pos & mMask];
+			diff = (intptr_t)pCell->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+
+			if (diff < 0)
+				return false; // full
+
+			if (diff > 0)
+			{
+				pos = mPosEnq.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			if (mPosEnq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+
+		pCell->data = data;
+		pCell->seq.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Executed by the consumer only
+	bool pop(T &data)
+	{
+		size_t pos = mPosDeq.load(std::memory_order_relaxed);
+		intptr_t diff;
+		Cell *pCell;
+
+		if (!mpCells)
+			return false;
+
+		pCell = &mpCells[pos & mMask];
+		diff = (intptr_t)pCell->seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+
+		if (diff < 0)
+			return false; // empty
+
+		data = pCell->data;
+		pCell->seq.store(pos + mMask + 1, std::memory_order_release);
+		mPosDeq.store(pos + 1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	// Approximation when used concurrently
+	size_t size() const
+	{
+		size_t posEnq = mPosEnq.load(std::memory_order_relaxed);
+		size_t posDeq = mPosDeq.load(std::memory_order_relaxed);
+
+		return posEnq > posDeq ? posEnq - posDeq : 0;
+	}
+
+	size_t capacity() const
+	{
+		return mpCells ? mMask + 1 : 0;
+	}
+
+private:
+
+	RingMpsc(const RingMpsc &) = delete;
+	RingMpsc &operator=(const RingMpsc &) = delete;
+
+	struct Cell
+	{
+		std::atomic<size_t> seq;
+		T data;
+	};
+
+	/* member variables */
+	Cell *mpCells;
+	size_t mMask;
+
+	// Separate cache lines for producers and consumer
+	alignas(64) std::atomic<size_t> mPosEnq;
+	alignas(64) std::atomic<size_t> mPosDeq;
+
+};
+
+#endif
+
@@ -23,7 +23,26 @@
   along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#if defined(__linux__)
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#if defined(__GXX_RTTI) || defined(_CPPRTTI)
+#include <typeinfo>
+#endif
+
 #include "ThreadPooling.h"
+#include "TimerWheel.h"
+#include "LibTime.h"
 
 #define dForEach_ProcState(gen) \
 		gen(StStart) \
@@ -44,6 +63,14 @@ dProcessStateEnum(ProcState);
 #define dGenSdStateEnum(s) s,
 dProcessStateEnum(SdState);
 
+enum RetireState
+{
+	RetireNone = 0,
+	RetireSubmittersWait,
+	RetireShutdownWait,
+	RetireRoundsWait,
+};
+
 #if 0
 #define dGenProcStateString(s) #s,
 dProcessStateStr(ProcState);
@@ -52,22 +79,135 @@ dProcessStateStr(SdState);
 #endif
 
 using namespace std;
+using namespace chrono;
 
 Pipe<PoolRequest> ThreadPooling::ppPoolRequests;
+atomic<ThreadPooling *> ThreadPooling::pPoolDirect(NULL);
+atomic<size_t> ThreadPooling::numSubmittersDirect(0);
+map<string, ThreadPooling *> ThreadPooling::pools;
+mutex ThreadPooling::mtxPools;
+thread_local ThreadPooling *ThreadPooling::pInternalTicking = NULL;
+
+const uint32_t cSizeQueueDefault = 1024;
+const uint32_t cMsIdleParkMax = 100;
+const uint32_t cMsIdleParkStealing = 10;
+const uint64_t cLoadRebalanceMinNs = 100000;
+const size_t cNumMigrationMax = 4;
+const uint32_t cNsIntervalCritical = 500000;
+const uint64_t cNsBudgetRound = 2000000;
+const uint32_t cMsIntervalScale = 1000;
+const uint32_t cNumScalesIdleRetire = 5;
+const uint32_t cPercentUtilGrow = 75;
+const uint32_t cPercentUtilRetire = 50;
+const size_t cNumQueuedGrow = 64;
+const uint16_t cNumHashNodesPerWorker = 128;
+const uint32_t cHashFnvOffset = 2166136261U;
+const uint32_t cHashFnvPrime = 16777619U;
+const uint32_t cMsIntervalStats = 1000;
+const size_t cNumSamplesDepthQueue = 10;
+const size_t cNumBinsHistTick = 8;
+const uint64_t cNsBoundHistTickFirst = 1000;
+const uint32_t cMsSleepMax = 100;
 
 ThreadPooling::ThreadPooling()
 	: Processing("ThreadPooling")
 	, mStateSd(StSdStart)
+	, mNamePool()
+	, mPpRequests()
+	, mDirectEnabled(false)
+	, mNumSubmittersDirect(0)
 	, mCntInternals(1)
+	, mCntInternalsMin(0)
+	, mCntInternalsMax(0)
+	, mNumInternals(0)
 	, mpFctDriverCreate(NULL)
+	, mWorkStealing(false)
+	, mSizeQueue(cSizeQueueDefault)
+	, mIdleParking(false)
+	, mPinning(PinningNone)
+	, mMemNodeLocal(false)
+	, mInternalsStarted(false)
+	, mCostProcNs(0)
+	, mIntervalRebalanceMs(0)
+	, mStartRebalanceMs(0)
+	, mBudgetTickNs(0)
+	, mStartScaleMs(0)
+	, mNumScalesIdle(0)
+	, mStateRetire(RetireNone)
+	, mpRetiring(NULL)
+	, mVecStats()
+	, mMtxStats()
 	, mIsInternal(false)
+	, mpPool(NULL)
+	, mIdxInternal(0)
+	, mCpuGroup()
 	, mNumProcessing(0)
+	, mNumDriven(0)
+	, mCostRoundNs(0)
+	, mBusyNs(0)
+	, mBusyScaleNs(0)
+	, mNumRounds(0)
+	, mCostTypes()
+	, mMtxCostTypes()
 	, mNumFinished(0)
+	, mNumStolen(0)
+	, mNumMigratedIn(0)
+	, mNumMigratedOut(0)
+	, mAcceptingWork(true)
+	, mIdxBulkNext(0)
 	, mMtxBrokerInternal()
+	, mTickLast()
+	, mTickCriticalLast()
+	, mStatsLast()
+	, mNumFinishedStats(0)
+	, mBusyStatsNs(0)
+	, mLatencyStartNs(0)
+	, mLatencyStartMaxNs(0)
+	, mDepthQueueMax(0)
+	, mVecDepthQueue()
+	, mHistTick()
+	, mVruntimeMinNs(0)
+	, mVruntimeRoundNs(0)
+	, mIdxThief(-1)
+	, mStealPending(false)
+	, mIdxMigrationTarget(-1)
+	, mCostMigrationNs(0)
+	, mParked(false)
+	, mParkingDisabled(false)
+	, mpProcTicking(NULL)
+	, mWakeupHint(false)
+	, mDeadlineHintMs(0)
+	, mFdHint(-1)
+	, mMsRound(0)
+	, mTickNested(false)
+	, mNumSleeping(0)
+	, mDeadlineNextMs(0)
+	, mVecFdsSleep()
+	, mVecFdsReady()
+#if defined(__linux__)
+	, mFdWakeup(-1)
+	, mVecPollFds()
+#else
+	, mMtxPark()
+	, mCondPark()
+	, mWakeupReq(false)
+#endif
 {
 	mState = StStart;
 }
 
+ThreadPooling::~ThreadPooling()
+{
+	poolUnregister();
+#if defined(__linux__)
+	if (mFdWakeup < 0)
+		return;
+
+	::close(mFdWakeup);
+	mFdWakeup = -1;
+#endif
+}
+
 /* member functions */
 
 void ThreadPooling::workerCntSet(uint16_t cnt)
@@ -75,13 +215,69 @@ void ThreadPooling::workerCntSet(uint16_t cnt)
 	mCntInternals = cnt;
 }
 
+void ThreadPooling::workerCntRangeSet(uint16_t cntMin, uint16_t cntMax)
+{
+	mCntInternalsMin = cntMin;
+	mCntInternalsMax = cntMax;
+}
+
 void ThreadPooling::driverCreateSet(FuncDriverPoolCreate pFctDriverCreate)
 {
 	mpFctDriverCreate = pFctDriverCreate;
 }
 
+void ThreadPooling::workStealingSet(bool en)
+{
+	mWorkStealing = en;
+}
+
+void ThreadPooling::sizeQueueSet(uint32_t size)
+{
+	mSizeQueue = size;
+}
+
+void ThreadPooling::idleParkingSet(bool en)
+{
+	mIdleParking = en;
+}
+
+void ThreadPooling::pinningSet(PoolPinning pinning, bool memNodeLocal)
+{
+	mPinning = pinning;
+	mMemNodeLocal = memNodeLocal;
+}
+
+void ThreadPooling::rebalanceIntervalSet(uint32_t intervalMs)
+{
+	mIntervalRebalanceMs = intervalMs;
+}
+
+void ThreadPooling::tickBudgetSet(uint32_t budgetUs)
+{
+	mBudgetTickNs = PMIN((uint64_t)budgetUs * 1000, UINT32_MAX);
+}
+
+void ThreadPooling::statsGet(PoolStats &stats)
+{
+	uint64_t boundNs = cNsBoundHistTickFirst;
+	size_t numInternals = mNumInternals;
+
+	stats.namePool = mNamePool;
+	stats.numWorkers = numInternals;
+
+	stats.vBoundsHistUs.clear();
+	for (size_t i = 0; i < cNumBinsHistTick - 1; ++i, boundNs <<= 2)
+		stats.vBoundsHistUs.push_back(boundNs / 1000);
+
+	Guard lock(mMtxStats);
+
+	numInternals = PMIN(numInternals, mVecStats.size());
+	stats.vWorkers.assign(mVecStats.begin(), mVecStats.begin() + numInternals);
+}
+
 Success ThreadPooling::process()
 {
+	ThreadPooling *pPoolNone = NULL;
 	//Success success;
 #if 0
 	dStateTrace;
@@ -101,41 +297,68 @@ Success ThreadPooling::process()
 		break;
 	case StBrokerStart:
 
+		if (mCntInternalsMax)
+		{
+			mCntInternalsMin = PMAX(mCntInternalsMin, 1);
+			mCntInternalsMax = PMAX(mCntInternalsMax, mCntInternalsMin);
+
+			mCntInternals = PMAX(mCntInternals, mCntInternalsMin);
+			mCntInternals = PMIN(mCntInternals, mCntInternalsMax);
+		}
+
 		if (!mCntInternals)
 			return procErrLog(-1, "no workers configured");
 
-		mVecInternals.reserve(mCntInternals);
+		// Never resized from now on. Accessed by all drivers
+		mVecInternals.assign(PMAX(mCntInternals, mCntInternalsMax), NULL);
 
-		for (uint16_t i = 0; i < mCntInternals; ++i)
 		{
-			ThreadPooling *pInternal;
+			Guard lock(mMtxStats);
+			mVecStats.assign(mVecInternals.size(), PoolWorkerStats());
+		}
 
-			pInternal = ThreadPooling::create();
-			if (!pInternal)
-				return procErrLog(-1, "could not create thread pool worker");
-
-			pInternal->mIsInternal = true;
-			mVecInternals.push_back(pInternal);
-
-			if (mpFctDriverCreate)
-			{
-				start(pInternal, DrivenByExternalDriver);
-				mpFctDriverCreate(pInternal, i);
-			}
-			else
-				start(pInternal, DrivenByNewInternalDriver);
+		cpuGroupsCreate(mCpuGroups);
+		hashNodesCreate();
+
+		for (uint16_t i = 0; i < mCntInternals; ++i)
+		{
+			if (!workerAdd(i))
+				return procErrLog(-1, "could not add thread pool worker");
 		}
 
+		// Workers may look at their siblings from now on
+		mNumInternals = mCntInternals;
+		mInternalsStarted = true;
+
+		mStartScaleMs = millis();
+
+		mDirectEnabled = true;
+
+		// Unnamed pools serve the default submissions
+		if (!mNamePool.size() && pPoolDirect.compare_exchange_strong(pPoolNone, this))
+			procDbgLog("accepting direct submissions");
+
 		mState = StBrokerMain;
 
 		break;
 	case StBrokerMain:
 
-		poolRequestsProcess();
+		if (!mNamePool.size())
+			poolRequestsProcess(ppPoolRequests);
+		poolRequestsProcess(mPpRequests);
+		procsRebalance();
+		workersScale();
+		workerRetire();
 
 		break;
 	case StInternalStart:
 
+		if (mCpuGroup.vIdCpus.size() && !cpusPin())
+			procWrnLog("could not pin worker to CPUs");
+
+		if (mpPool->mIdleParking && !wakeupInit())
+			return procErrLog(-1, "could not initialize wakeup of worker");
+
 		mState = StInternalMain;
 
 		break;
@@ -143,6 +366,10 @@ Success ThreadPooling::process()
 
 		procsDrive();
 
+		// Sleeping processes don't need the worker
+		if (mpPool->mIdleParking && numEntriesGet() <= mNumSleeping)
+			idlePark();
+
 		break;
 	default:
 		break;
@@ -153,7 +380,9 @@ Success ThreadPooling::process()
 
 Success ThreadPooling::shutdown()
 {
-	uint16_t i;
+	ThreadPooling *pPoolSelf = this;
+	ThreadPooling *pInternal;
+	size_t i;
 
 	switch (mStateSd)
 	{
@@ -165,17 +394,34 @@ Success ThreadPooling::shutdown()
 			break;
 		}
 
-		for (i = 0; i < mCntInternals; ++i)
-			cancel(mVecInternals[i]);
+		// No direct submissions after this point
+		pPoolDirect.compare_exchange_strong(pPoolSelf, NULL);
+		mDirectEnabled = false;
+		poolUnregister();
+
+		if (numSubmittersDirect || mNumSubmittersDirect)
+			return Pending;
+
+		for (i = 0; i < mVecInternals.size(); ++i)
+		{
+			pInternal = mVecInternals[i];
+			if (!pInternal)
+				continue;
+
+			pInternal->mParkingDisabled = true;
+			cancel(pInternal);
+			pInternal->wakeup();
+		}
 
 		mStateSd = StBrokerSdStart;
 
 		break;
 	case StBrokerSdStart:
 
-		for (i = 0; i < mCntInternals; ++i)
+		for (i = 0; i < mVecInternals.size(); ++i)
 		{
-			if (!mVecInternals[i]->shutdownDone())
+			pInternal = mVecInternals[i];
+			if (pInternal && !pInternal->shutdownDone())
 				return Pending;
 		}
 
@@ -184,9 +430,18 @@ Success ThreadPooling::shutdown()
 		break;
 	case StInternalSdStart:
 
+		{
+			Guard lock(mMtxBrokerInternal);
+			mAcceptingWork = false;
+		}
+
 		procsDrive();
 
-		if (mListProcs.size())
+		// Retired by the broker. Siblings take over
+		if (mIdxInternal >= mpPool->mNumInternals)
+			procsRetire();
+
+		if (numEntriesGet())
 		{
 			procDbgLog("driving not finished");
 
@@ -201,7 +456,7 @@ Success ThreadPooling::shutdown()
 
 		procsDrive();
 
-		if (mListProcs.size())
+		if (numEntriesGet())
 			break;
 
 		return Positive;
@@ -214,122 +469,2109 @@ Success ThreadPooling::shutdown()
 	return Pending;
 }
 
-void ThreadPooling::poolRequestsProcess()
+void ThreadPooling::poolRequestsProcess(Pipe<PoolRequest> &ppRequests)
 {
 	PipeEntry<PoolRequest> entryReq;
-	PoolRequest req;
+	PoolEntry entry;
 	int32_t idDriver;
 
-	while (ppPoolRequests.get(entryReq) > 0)
+	while (ppRequests.get(entryReq) > 0)
 	{
-		req = entryReq.particle;
-
 		procDbgLog("pool request received");
 
-		if (req.idDriverDesired >= 0 && req.idDriverDesired < mCntInternals)
-			idDriver = req.idDriverDesired;
-		else
-			idDriver = idDriverNextGet();
+		entryFromRequest(entryReq.particle, entry, idDriver);
+		mVecInternals[idDriver]->procInternalAdd(entry);
+	}
+}
+
+bool ThreadPooling::workerAdd(uint16_t idx)
+{
+	ThreadPooling *pInternal;
+
+	pInternal = ThreadPooling::create();
+	if (!pInternal)
+	{
+		procErrLog(-1, "could not create thread pool worker");
+		return false;
+	}
+
+	pInternal->mIsInternal = true;
+	pInternal->mpPool = this;
+	pInternal->mIdxInternal = idx;
 
-		mVecInternals[idDriver]->procInternalAdd(req.pProc);
+	if (mCpuGroups.size())
+		pInternal->mCpuGroup = mCpuGroups[idx % mCpuGroups.size()];
+
+	pInternal->mStatsLast = steady_clock::now();
+	pInternal->mHistTick.assign(cNumBinsHistTick, 0);
+
+	{
+		Guard lock(mMtxStats);
+
+		mVecStats[idx] = PoolWorkerStats();
+		mVecStats[idx].idWorker = idx;
+	}
+
+	if (!pInternal->mRingProcsReq.init(mSizeQueue))
+	{
+		procErrLog(-1, "could not create queue of thread pool worker");
+		Processing::destroy(pInternal);
+		return false;
+	}
+
+	mVecInternals[idx] = pInternal;
+
+	if (mpFctDriverCreate)
+	{
+		start(pInternal, DrivenByExternalDriver);
+		mpFctDriverCreate(pInternal, idx);
 	}
+	else
+		start(pInternal, DrivenByNewInternalDriver);
+
+	return true;
 }
 
-void ThreadPooling::procsDrive()
+/*
+ * Dynamic worker count
+ *
+ * Once per interval, the broker samples the utilization of
+ * the workers and the number of processes not driven yet. A
+ * worker is added if the workers are busy or the queues are
+ * growing. The worker with the highest index is retired if
+ * the remaining workers were able to take over its load for
+ * several intervals. It hands over its processes and stops
+ * through the regular shutdown path.
+ */
+void ThreadPooling::workersScale()
 {
-	list<Processing *>::iterator iter;
-	Processing *pProc;
+	uint32_t curTimeMs = millis();
+	uint32_t diffMs = curTimeMs - mStartScaleMs;
+	size_t numInternals = mNumInternals;
+	ThreadPooling *pInternal;
+	uint64_t busyNs, busySumNs = 0;
+	uint64_t capacityNs;
+	size_t numProcessing, numDriven;
+	size_t numQueued = 0;
+	size_t i;
+
+	if (!mCntInternalsMax || diffMs < cMsIntervalScale)
+		return;
+	mStartScaleMs = curTimeMs;
 
+	for (i = 0; i < numInternals; ++i)
 	{
-		Guard lock(mMtxBrokerInternal);
-		mListProcs.splice(mListProcs.end(), mListProcsReq);
+		pInternal = mVecInternals[i];
+
+		busyNs = pInternal->mBusyNs.load(memory_order_relaxed);
+		busySumNs += busyNs - pInternal->mBusyScaleNs;
+		pInternal->mBusyScaleNs = busyNs;
+
+		numProcessing = pInternal->mNumProcessing;
+		numDriven = pInternal->mNumDriven;
+
+		if (numProcessing > numDriven)
+			numQueued += numProcessing - numDriven;
+	}
+
+	if (mStateRetire != RetireNone)
+		return;
+
+	capacityNs = (uint64_t)diffMs * 1000000 * numInternals;
+
+	if (numInternals < mCntInternalsMax &&
+			(busySumNs * 100 > capacityNs * cPercentUtilGrow ||
+			numQueued > numInternals * cNumQueuedGrow))
+	{
+		mNumScalesIdle = 0;
+
+		if (!workerAdd(numInternals))
+			return;
+
+		// Visible to submitters from now on
+		mNumInternals = numInternals + 1;
+
+		procDbgLog("added worker %zu", numInternals);
+		return;
 	}
 
-	iter = mListProcs.begin();
-	while (iter != mListProcs.end())
+	// Load of remaining workers must stay below threshold
+	capacityNs = capacityNs / numInternals * (numInternals - 1);
+
+	if (numInternals > mCntInternalsMin && !numQueued &&
+			busySumNs * 100 < capacityNs * cPercentUtilRetire)
+		++mNumScalesIdle;
+	else
+		mNumScalesIdle = 0;
+
+	if (mNumScalesIdle < cNumScalesIdleRetire)
+		return;
+	mNumScalesIdle = 0;
+
+	// No new processes for this worker from now on
+	mpRetiring = mVecInternals[numInternals - 1];
+	mNumInternals = numInternals - 1;
+
+	mStateRetire = RetireSubmittersWait;
+
+	procDbgLog("retiring worker %zu", numInternals - 1);
+}
+
+/*
+ * A retired worker is destroyed only after every sibling
+ * finished a round. Until then, siblings may still reference
+ * it as thief, victim or migration target.
+ */
+void ThreadPooling::workerRetire()
+{
+	ThreadPooling *pRetiring = mpRetiring;
+	size_t numInternals = mNumInternals;
+	ThreadPooling *pInternal;
+	int32_t idxRetiring, idx;
+	size_t i;
+
+	switch (mStateRetire)
 	{
-		pProc = *iter;
+	case RetireSubmittersWait:
+
+		// Direct submitters may still use the old number of workers
+		if (numSubmittersDirect || mNumSubmittersDirect)
+			break;
+
+		pRetiring->mParkingDisabled = true;
+		cancel(pRetiring);
+		pRetiring->wakeup();
+
+		mStateRetire = RetireShutdownWait;
+
+		break;
+	case RetireShutdownWait:
+
+		if (!pRetiring->shutdownDone())
+			break;
 
-		pProc->treeTick();
+		idxRetiring = pRetiring->mIdxInternal;
+		mVecRoundsRetire.resize(numInternals);
 
-		if (pProc->progress())
+		for (i = 0; i < numInternals; ++i)
 		{
-			++iter;
-			continue;
+			pInternal = mVecInternals[i];
+
+			idx = idxRetiring;
+			pInternal->mIdxThief.compare_exchange_strong(idx, -1);
+
+			idx = idxRetiring;
+			pInternal->mIdxMigrationTarget.compare_exchange_strong(idx, -1);
+
+			mVecRoundsRetire[i] = pInternal->mNumRounds;
 		}
 
-		procDbgLog("finished driving process %p", pProc);
+		mStateRetire = RetireRoundsWait;
+
+		break;
+	case RetireRoundsWait:
+
+		for (i = 0; i < numInternals; ++i)
 		{
-			Guard lock(mMtxBrokerInternal);
-			--mNumProcessing;
+			pInternal = mVecInternals[i];
+
+			if (pInternal->mNumRounds <= mVecRoundsRetire[i] && !pInternal->mParked)
+				return;
 		}
-		++mNumFinished;
 
-		undrivenSet(pProc);
-		iter = mListProcs.erase(iter);
+		// Registered as victim in the meantime
+		idx = pRetiring->mIdxThief;
+		if (idx >= 0)
+			mVecInternals[idx]->mStealPending = false;
+
+		idxRetiring = pRetiring->mIdxInternal;
+		mVecInternals[idxRetiring] = NULL;
+
+		repel(pRetiring);
+		mpRetiring = NULL;
+
+		procDbgLog("worker %d retired", idxRetiring);
+
+		mStateRetire = RetireNone;
+
+		break;
+	default:
+		break;
 	}
 }
 
-int32_t ThreadPooling::idDriverNextGet()
+// Executed by retiring worker. Keyed processes follow their key
+size_t ThreadPooling::procsKeyedHandOver()
 {
-	size_t idCurrent = 1;
-	size_t numProcessingCurrent;
-	int32_t idSelected = 0;
-	size_t numProcessingSelected =
-			mVecInternals[idSelected]->numProcessingGet();
+	map<int32_t, vector<PoolEntry> > mapEntries;
+	map<int32_t, vector<PoolEntry> >::iterator iTarget;
+	vector<PoolEntry>::iterator iter;
+	size_t numHandedOver = 0;
+	size_t numEntries;
+	size_t idx;
+	int prio;
+
+	for (prio = PrioCritical; prio <= PrioBulk; ++prio)
+	{
+		vector<PoolEntry> &vProcs = mVecProcs[prio];
+
+		for (idx = vProcs.size(); idx; --idx)
+		{
+			PoolEntry &entry = vProcs[idx - 1];
+
+			if (!entry.keyed)
+				continue;
+
+			mapEntries[mpPool->idDriverKeyGet(entry.hashKey)].push_back(entry);
+
+			entry = vProcs.back();
+			vProcs.pop_back();
+		}
+	}
 
-	for (; idCurrent < mVecInternals.size(); ++idCurrent)
+	iTarget = mapEntries.begin();
+	for (; iTarget != mapEntries.end(); ++iTarget)
 	{
-		numProcessingCurrent =
-			mVecInternals[idCurrent]->numProcessingGet();
+		numEntries = iTarget->second.size();
 
-		if (numProcessingCurrent >= numProcessingSelected)
+		if (mpPool->mVecInternals[iTarget->first]->procsInternalAdd(iTarget->second))
+		{
+			numHandedOver += numEntries;
 			continue;
-		numProcessingSelected = numProcessingCurrent;
+		}
 
-		idSelected = idCurrent;
+		// Target is shutting down. Keep them
+		iter = iTarget->second.begin();
+		for (; iter != iTarget->second.end(); ++iter)
+			mVecProcs[iter->prio].push_back(*iter);
 	}
 
-	return idSelected;
+	mNumProcessing -= numHandedOver;
+	mNumDriven = numEntriesGet();
+
+	return numHandedOver;
 }
 
-size_t ThreadPooling::numProcessingGet()
+// Executed by retiring worker
+void ThreadPooling::procsRetire()
 {
-	Guard lock(mMtxBrokerInternal);
-	return mNumProcessing;
+	size_t numInternals = mpPool->mNumInternals;
+	vector<PoolEntry>::iterator iter;
+	size_t numEntries, numShare;
+	size_t numHandedOver;
+	size_t i;
+	int prio;
+
+	numHandedOver = procsKeyedHandOver();
+
+	// Pinning ends with the worker
+	for (prio = PrioCritical; prio <= PrioBulk; ++prio)
+	{
+		iter = mVecProcs[prio].begin();
+		for (; iter != mVecProcs[prio].end(); ++iter)
+			iter->pinned = false;
+	}
+
+	for (i = 0; i < numInternals; ++i)
+	{
+		numEntries = numEntriesGet();
+		if (!numEntries)
+			break;
+
+		numShare = (numEntries + numInternals - i - 1) / (numInternals - i);
+		numHandedOver += procsHandOver(mpPool->mVecInternals[i], numShare, UINT64_MAX);
+	}
+
+	// Bound to nodes without equal share
+	for (i = 0; i < numInternals && numEntriesGet(); ++i)
+		numHandedOver += procsHandOver(mpPool->mVecInternals[i], numEntriesGet(), UINT64_MAX);
+
+	if (numEntriesGet())
+	{
+		// Bound to nodes without workers left
+		for (prio = PrioCritical; prio <= PrioBulk; ++prio)
+		{
+			iter = mVecProcs[prio].begin();
+			for (; iter != mVecProcs[prio].end(); ++iter)
+				iter->idNode = -1;
+		}
+
+		numHandedOver += procsHandOver(mpPool->mVecInternals[mpPool->idDriverNextGet()],
+							numEntriesGet(), UINT64_MAX);
+	}
+
+	procDbgLog("handed over %zu processes", numHandedOver);
 }
 
-// Executed by broker (different driver)
-void ThreadPooling::procInternalAdd(Processing *pProc)
+void ThreadPooling::procsDrive()
 {
-	Guard lock(mMtxBrokerInternal);
-	mListProcsReq.push_back(pProc);
-	++mNumProcessing;
+	vector<PoolEntry>::iterator iter;
+	PoolEntry entry;
+	uint64_t costRoundNs = 0;
+	size_t numEntries;
+	size_t depthQueue = 0;
+
+	while (mRingProcsReq.pop(entry))
+	{
+		entryIntake(entry);
+		mVecProcs[entry.prio].push_back(entry);
+		++depthQueue;
+	}
+
+	// Double buffering. Both buffers keep their capacity
+	{
+		Guard lock(mMtxBrokerInternal);
+		mVecProcsIntake.swap(mVecProcsReq);
+	}
+
+	iter = mVecProcsIntake.begin();
+	for (; iter != mVecProcsIntake.end(); ++iter)
+	{
+		entryIntake(*iter);
+		mVecProcs[iter->prio].push_back(*iter);
+	}
+
+	depthQueue += mVecProcsIntake.size();
+	mVecProcsIntake.clear();
+
+	mTickLast = steady_clock::now();
+	mVruntimeRoundNs = UINT64_MAX;
+
+	// Same clock as millis(). No additional clock read
+	mMsRound = time_point_cast<milliseconds>(mTickLast).time_since_epoch().count();
+	TimerWheel::advance(mMsRound);
+
+	pInternalTicking = this;
+	mNumSleeping = 0;
+	fdsSleepPoll();
+
+	procsTick(PrioCritical, costRoundNs);
+	procsTick(PrioNormal, costRoundNs);
+	procsTick(PrioBulk, costRoundNs);
+
+	if (mVruntimeRoundNs != UINT64_MAX && mVruntimeRoundNs > mVruntimeMinNs)
+		mVruntimeMinNs = mVruntimeRoundNs;
+
+	numEntries = numEntriesGet();
+	mNumDriven = numEntries;
+
+	// Idle workers must not look busy
+	if (!numEntries)
+		mCostRoundNs = 0;
+	else
+		mCostRoundNs = ewmaUpdate(mCostRoundNs, PMIN(costRoundNs, UINT32_MAX));
+
+	mBusyNs.fetch_add(costRoundNs, memory_order_relaxed);
+
+	statsUpdate(depthQueue);
+
+	procsMigrate();
+
+	if (mpPool->mWorkStealing)
+	{
+		procsDonate();
+		procsSteal();
+	}
+
+	// Siblings are not referenced anymore. See workerRetire()
+	++mNumRounds;
 }
 
-void ThreadPooling::procAdd(Processing *pProc, int32_t idDriver)
+/*
+ * Priority classes
+ *
+ * Critical processes are driven first in every round. While
+ * normal and bulk processes are driven, the critical ones are
+ * driven again as soon as their interval has elapsed. Bulk
+ * processes only get the budget left over in a round. They
+ * are driven in turns and at least one of them per round.
+ * Therefore none of them starves.
+ *
+ * Fair share
+ *
+ * Every process accumulates the time spent in its ticks as
+ * virtual runtime. Processes exceeding the tick budget
+ * repeatedly are offenders. A non-critical offender is
+ * skipped until the virtual runtime of the other processes
+ * has caught up. The minimum virtual runtime of a worker
+ * never decreases. New processes start at this minimum.
+ *
+ * Literature
+ * - https://docs.kernel.org/scheduler/sched-design-CFS.html
+ */
+void ThreadPooling::procsTick(PoolPriority prio, uint64_t &costRoundNs)
 {
-	PoolRequest req;
+	vector<PoolEntry> &vProcs = mVecProcs[prio];
+	steady_clock::time_point tTickEnd;
+	size_t numTicked = 0;
+	size_t idx = 0;
+	uint32_t costNs;
 
-	req.pProc = pProc;
-	req.idDriverDesired = idDriver;
+	if (prio == PrioCritical)
+		mTickCriticalLast = mTickLast;
 
-	dbgLog("adding proc %p to queue", pProc);
-	ppPoolRequests.commit(req);
+	// Bulk processes continue where they stopped
+	if (prio == PrioBulk && mIdxBulkNext < vProcs.size())
+		idx = mIdxBulkNext;
+
+	while (idx < vProcs.size())
+	{
+		if (prio == PrioBulk && numTicked && costRoundNs >= cNsBudgetRound)
+			break;
+
+		PoolEntry &entry = vProcs[idx];
+
+		if (entry.sleeping && !entryAwake(entry))
+		{
+			if (!mTickNested)
+				sleepAccount(entry);
+
+			++idx;
+			continue;
+		}
+
+		if (prio != PrioCritical && entry.vruntimeNs < mVruntimeRoundNs)
+			mVruntimeRoundNs = entry.vruntimeNs;
+
+		if (prio != PrioCritical && entry.offending &&
+				entry.vruntimeNs > mVruntimeMinNs)
+		{
+			++idx;
+			continue;
+		}
+
+		if (!entry.started)
+			latencyStartRecord(entry);
+
+		mpProcTicking = entry.pProc;
+		mWakeupHint = false;
+		entry.pProc->treeTick();
+		mpProcTicking = NULL;
+		++numTicked;
+
+		// One clock read per tick
+		tTickEnd = steady_clock::now();
+		costNs = PMIN(duration_cast<nanoseconds>(tTickEnd - mTickLast).count(), UINT32_MAX);
+		mTickLast = tTickEnd;
+
+		costRecord(entry, costNs);
+		costRoundNs += costNs;
+
+		if (entry.pProc->progress())
+		{
+			if (mWakeupHint)
+				entrySleep(entry);
+			++idx;
+		}
+		else
+		{
+			entryFinish(entry);
+
+			// Swap-remove. Last entry not driven in this pass yet
+			entry = vProcs.back();
+			vProcs.pop_back();
+		}
+
+		if (prio == PrioCritical || !mVecProcs[PrioCritical].size())
+			continue;
+
+		if (mTickLast - mTickCriticalLast < nanoseconds(cNsIntervalCritical))
+			continue;
+
+		mTickNested = true;
+		procsTick(PrioCritical, costRoundNs);
+		mTickNested = false;
+	}
+
+	if (prio == PrioBulk)
+		mIdxBulkNext = idx;
 }
 
-void ThreadPooling::processInfo(char *pBuf, char *pBufEnd)
+void ThreadPooling::entryFinish(PoolEntry &entry)
 {
-#if 0
-	dInfo("State\t\t\t%s\n", ProcStateString[mState]);
-	dInfo("State shutdown\t\t%s\n", SdStateString[mStateSd]);
-#endif
-	if (!mIsInternal)
-		return;
+	PoolCompletion *pCompletion = entry.pCompletion;
+	Success success = Pending;
 
-	dInfo("Processing\t\t%zu\n", mNumProcessing);
-	//dInfo("Finished\t\t%zu\n", mNumFinished);
-}
+	procDbgLog("finished driving process %p", entry.pProc);
 
-/* static functions */
+	--mNumProcessing;
+	++mNumFinished;
+
+	// Process may be destroyed by its parent after undrivenSet()
+	if (pCompletion)
+		success = entry.pProc->success();
+
+	if (pCompletion && pCompletion->mpFctDone)
+		pCompletion->mpFctDone(entry.pProc, success, pCompletion->mpUser);
+
+	undrivenSet(entry.pProc);
+
+	if (!pCompletion)
+		return;
+
+	// Completion may be destroyed by its owner afterwards
+	pCompletion->finish(success);
+}
+
+size_t ThreadPooling::numEntriesGet()
+{
+	return mVecProcs[PrioCritical].size() +
+			mVecProcs[PrioNormal].size() +
+			mVecProcs[PrioBulk].size();
+}
+
+/*
+ * Work stealing
+ *
+ * Only the owner of an entry ever ticks its process.
+ * Therefore an idle worker does not take processes by itself.
+ * It registers as thief at the busiest worker instead. The
+ * victim hands over half of its unpinned processes from the
+ * back of its storage between two ticks.
+ *
+ * Literature
+ * - https://en.wikipedia.org/wiki/Work_stealing
+ * - https://dl.acm.org/doi/10.1145/324133.324234
+ */
+void ThreadPooling::procsSteal()
+{
+	size_t numInternals = mpPool->mNumInternals;
+	ThreadPooling *pVictim = NULL;
+	ThreadPooling *pInternal;
+	uint64_t loadMax = 0;
+	uint64_t load;
+	int32_t idxNone = -1;
+
+	if (numEntriesGet() || mStealPending || !mpPool->mInternalsStarted)
+		return;
+
+	{
+		Guard lock(mMtxBrokerInternal);
+
+		if (!mAcceptingWork || mVecProcsReq.size())
+			return;
+	}
+
+	for (size_t i = 0; i < numInternals; ++i)
+	{
+		pInternal = mpPool->mVecInternals[i];
+
+		if (pInternal == this)
+			continue;
+
+		// Nothing to share
+		if (pInternal->numProcessingGet() < 2)
+			continue;
+
+		load = pInternal->loadGet();
+		if (pVictim && load <= loadMax)
+			continue;
+		loadMax = load;
+
+		pVictim = pInternal;
+	}
+
+	if (!pVictim)
+		return;
+
+	// Must be set before the victim is able to see us
+	mStealPending = true;
+
+	if (pVictim->mIdxThief.compare_exchange_strong(idxNone, mIdxInternal))
+		return;
+
+	mStealPending = false;
+}
+
+void ThreadPooling::procsDonate()
+{
+	int32_t idxThief = mIdxThief;
+	ThreadPooling *pThief;
+	size_t numDonated;
+
+	if (idxThief < 0)
+		return;
+
+	pThief = mpPool->mVecInternals[idxThief];
+
+	numDonated = procsHandOver(pThief, numEntriesGet() >> 1, UINT64_MAX);
+	if (numDonated)
+	{
+		procDbgLog("donated %zu processes to worker %d", numDonated, idxThief);
+		pThief->mNumStolen += numDonated;
+	}
+
+	// Registration may have been cleared by the broker already
+	mIdxThief.compare_exchange_strong(idxThief, -1);
+	pThief->mStealPending = false;
+}
+
+/*
+ * Live migration
+ *
+ * The broker periodically compares the loads of the workers.
+ * If they differ too much, the most loaded worker is asked to
+ * move processes worth half of the difference to the least
+ * loaded worker. Only a few processes are moved at once to
+ * prevent oscillation. Like stolen processes, migrated
+ * processes change their owner between two ticks. Pinned
+ * processes are never moved.
+ */
+void ThreadPooling::procsRebalance()
+{
+	uint32_t curTimeMs = millis();
+	uint32_t diffMs = curTimeMs - mStartRebalanceMs;
+	ThreadPooling *pInternal;
+	ThreadPooling *pMax = NULL;
+	int32_t idxMin = -1;
+	uint64_t loadMin = 0, loadMax = 0;
+	uint64_t load;
+	size_t i;
+
+	if (!mIntervalRebalanceMs || diffMs < mIntervalRebalanceMs)
+		return;
+	mStartRebalanceMs = curTimeMs;
+
+	for (i = 0; i < mNumInternals; ++i)
+	{
+		pInternal = mVecInternals[i];
+
+		// Previous request still pending
+		if (pInternal->mIdxMigrationTarget >= 0)
+			return;
+
+		load = pInternal->loadGet();
+
+		if (!pMax || load > loadMax)
+		{
+			loadMax = load;
+			pMax = pInternal;
+		}
+
+		if (idxMin < 0 || load < loadMin)
+		{
+			loadMin = load;
+			idxMin = i;
+		}
+	}
+
+	if (!pMax || pMax == mVecInternals[idxMin])
+		return;
+
+	if (loadMax < cLoadRebalanceMinNs)
+		return;
+
+	if (loadMax - loadMin <= loadMax >> 2)
+		return;
+
+	pMax->mCostMigrationNs = (loadMax - loadMin) >> 1;
+	pMax->mIdxMigrationTarget = idxMin;
+}
+
+void ThreadPooling::procsMigrate()
+{
+	int32_t idxTarget = mIdxMigrationTarget;
+	ThreadPooling *pTarget;
+	uint64_t costMigrationNs = mCostMigrationNs;
+	size_t numMigrated;
+
+	if (idxTarget < 0)
+		return;
+
+	pTarget = mpPool->mVecInternals[idxTarget];
+
+	numMigrated = procsHandOver(pTarget, cNumMigrationMax, costMigrationNs);
+	if (numMigrated)
+	{
+		procDbgLog("migrated %zu processes to worker %d", numMigrated, idxTarget);
+		mNumMigratedOut += numMigrated;
+		pTarget->mNumMigratedIn += numMigrated;
+	}
+
+	mIdxMigrationTarget = -1;
+}
+
+// Executed by owner of the processes between two ticks
+size_t ThreadPooling::procsHandOver(ThreadPooling *pTarget, size_t numMax, uint64_t costMaxNs)
+{
+	vector<PoolEntry> vEntries;
+	vector<PoolEntry>::iterator iter;
+	uint64_t costNs = 0;
+	size_t numEntries;
+	size_t idx;
+	int prio;
+
+	// Least urgent processes first
+	for (prio = PrioBulk; prio >= PrioCritical; --prio)
+	{
+		vector<PoolEntry> &vProcs = mVecProcs[prio];
+
+		for (idx = vProcs.size(); idx && vEntries.size() < numMax; --idx)
+		{
+			PoolEntry &entry = vProcs[idx - 1];
+
+			if (entry.pinned)
+				continue;
+
+			if (entry.idNode >= 0 && entry.idNode != pTarget->mCpuGroup.idNode)
+				continue;
+
+			// Would only shift the imbalance
+			if (costMaxNs != UINT64_MAX && costNs + entry.costTickNs > costMaxNs)
+				continue;
+
+			costNs += entry.costTickNs;
+
+			vEntries.push_back(entry);
+
+			// Swap-remove. Last entry was checked already
+			entry = vProcs.back();
+			vProcs.pop_back();
+		}
+	}
+
+	numEntries = vEntries.size();
+	if (!numEntries)
+		return 0;
+
+	if (!pTarget->procsInternalAdd(vEntries))
+	{
+		// Target is shutting down. Keep them
+		iter = vEntries.begin();
+		for (; iter != vEntries.end(); ++iter)
+			mVecProcs[iter->prio].push_back(*iter);
+		return 0;
+	}
+
+	mNumProcessing -= numEntries;
+	mNumDriven = numEntriesGet();
+
+	// Don't wait for the moving average
+	mCostRoundNs = mCostRoundNs > costNs ? mCostRoundNs - costNs : 0;
+
+	return numEntries;
+}
+
+int32_t ThreadPooling::idDriverNextGet(int32_t idNode, const vector<uint64_t> *pVecLoads)
+{
+	size_t numInternals = pVecLoads ? pVecLoads->size() : mNumInternals.load();
+	size_t idCurrent = 0;
+	ThreadPooling *pInternal;
+	uint64_t loadCurrent, loadSelected = 0;
+	size_t numProcessingCurrent;
+	int32_t idSelected = -1;
+	size_t numProcessingSelected = 0;
+
+	for (; idCurrent < numInternals; ++idCurrent)
+	{
+		pInternal = mVecInternals[idCurrent];
+
+		if (idNode >= 0 && pInternal->mCpuGroup.idNode != idNode)
+			continue;
+
+		// Loads of a batch not submitted yet
+		if (pVecLoads)
+			loadCurrent = (*pVecLoads)[idCurrent];
+		else
+			loadCurrent = pInternal->loadGet();
+
+		numProcessingCurrent = pInternal->numProcessingGet();
+
+		// Number of processes breaks ties. Eg. no costs measured yet
+		if (idSelected >= 0 && loadCurrent > loadSelected)
+			continue;
+
+		if (idSelected >= 0 && loadCurrent == loadSelected &&
+				numProcessingCurrent >= numProcessingSelected)
+			continue;
+
+		loadSelected = loadCurrent;
+		numProcessingSelected = numProcessingCurrent;
+
+		idSelected = idCurrent;
+	}
+
+	// No worker on this node
+	if (idSelected < 0 && idNode >= 0)
+		return idDriverNextGet(-1, pVecLoads);
+
+	return idSelected;
+}
+
+/*
+ * Key affinity
+ *
+ * Processes with the same key are driven by the same worker.
+ * Keys are mapped to workers using consistent hashing. Every
+ * possible worker owns several points on a hash ring. A key
+ * belongs to the first active worker found clockwise from the
+ * hash of the key. If a worker is added or retired, only the
+ * keys of this worker move. The ring is created once for the
+ * maximum number of workers. Therefore submitters don't need
+ * a lock.
+ *
+ * Literature
+ * - https://en.wikipedia.org/wiki/Consistent_hashing
+ * - http://www.isthe.com/chongo/tech/comp/fnv/
+ */
+void ThreadPooling::hashNodesCreate()
+{
+	PoolHashNode node;
+	uint16_t ids[2];
+
+	mVecHashNodes.clear();
+	mVecHashNodes.reserve(mVecInternals.size() * cNumHashNodesPerWorker);
+
+	for (size_t i = 0; i < mVecInternals.size(); ++i)
+	{
+		for (uint16_t k = 0; k < cNumHashNodesPerWorker; ++k)
+		{
+			ids[0] = i;
+			ids[1] = k;
+
+			node.hash = hashFnv(ids, sizeof(ids));
+			node.idDriver = i;
+
+			mVecHashNodes.push_back(node);
+		}
+	}
+
+	sort(mVecHashNodes.begin(), mVecHashNodes.end(),
+		[](const PoolHashNode &a, const PoolHashNode &b) { return a.hash < b.hash; });
+}
+
+int32_t ThreadPooling::idDriverKeyGet(uint32_t hashKey)
+{
+	size_t numInternals = mNumInternals;
+	vector<PoolHashNode>::const_iterator iter;
+
+	iter = lower_bound(mVecHashNodes.begin(), mVecHashNodes.end(), hashKey,
+		[](const PoolHashNode &node, uint32_t hash) { return node.hash < hash; });
+
+	for (size_t i = 0; i < mVecHashNodes.size(); ++i, ++iter)
+	{
+		if (iter == mVecHashNodes.end())
+			iter = mVecHashNodes.begin();
+
+		if (iter->idDriver < numInternals)
+			return iter->idDriver;
+	}
+
+	return idDriverNextGet();
+}
+
+size_t ThreadPooling::numProcessingGet()
+{
+	return mNumProcessing;
+}
+
+/*
+ * Cost-aware load balancing
+ *
+ * Every worker measures the time spent in each tick. The
+ * load of a worker is the moving average of the time
+ * needed for one round over all of its processes. Processes
+ * not driven yet are estimated with the average cost of a
+ * process in the pool.
+ *
+ * Literature
+ * - https://en.wikipedia.org/wiki/Exponential_smoothing
+ */
+uint64_t ThreadPooling::loadGet()
+{
+	size_t numProcessing = mNumProcessing;
+	size_t numDriven = mNumDriven;
+	size_t numQueued = 0;
+
+	if (numProcessing > numDriven)
+		numQueued = numProcessing - numDriven;
+
+	return mCostRoundNs + (uint64_t)numQueued * mpPool->mCostProcNs;
+}
+
+// Executed by worker when an entry enters its storage
+void ThreadPooling::entryIntake(PoolEntry &entry)
+{
+	// Type costs are owned by the worker. Entries may be stolen
+	{
+		Guard lock(mMtxCostTypes);
+		entry.pCostType = &mCostTypes[typeNameGet(entry.pProc)];
+	}
+
+	if (!entry.costTickNs)
+		entry.costTickNs = entry.pCostType->costTickNs;
+
+	// Virtual runtime is local to the worker
+	entry.vruntimeNs = mVruntimeMinNs;
+}
+
+void ThreadPooling::costRecord(PoolEntry &entry, uint32_t costNs)
+{
+	uint32_t budgetNs = mpPool->mBudgetTickNs;
+	PoolCostType *pCostType = entry.pCostType;
+	uint64_t boundNs = cNsBoundHistTickFirst;
+	size_t idxBin = 0;
+	bool offending;
+
+	while (idxBin < cNumBinsHistTick - 1 && costNs >= boundNs)
+	{
+		++idxBin;
+		boundNs <<= 2;
+	}
+
+	++mHistTick[idxBin];
+
+	entry.costTickNs = ewmaUpdate(entry.costTickNs, costNs);
+	entry.vruntimeNs += costNs;
+
+	pCostType->costTickNs = ewmaUpdate(pCostType->costTickNs, costNs);
+	++pCostType->numTicks;
+
+	if (costNs > pCostType->costTickMaxNs)
+		pCostType->costTickMaxNs = costNs;
+
+	// Lost updates of other workers don't matter here
+	mpPool->mCostProcNs.store(
+		ewmaUpdate(mpPool->mCostProcNs.load(memory_order_relaxed), costNs),
+		memory_order_relaxed);
+
+	if (!budgetNs)
+		return;
+
+	if (costNs > budgetNs)
+	{
+		++entry.numOverruns;
+		++pCostType->numOverruns;
+	}
+
+	// Single outliers are tolerated
+	offending = entry.numOverruns > 1 && entry.costTickNs > budgetNs;
+
+	if (offending && !entry.offending)
+		procDbgLog("process %p exceeds tick budget: %.3fms",
+					entry.pProc, entry.costTickNs / 1000000.0);
+
+	entry.offending = offending;
+}
+
+void ThreadPooling::latencyStartRecord(PoolEntry &entry)
+{
+	uint32_t latencyNs = 0;
+
+	entry.started = true;
+
+	if (mTickLast > entry.tSubmit)
+		latencyNs = PMIN(duration_cast<nanoseconds>(mTickLast - entry.tSubmit).count(), UINT32_MAX);
+
+	mLatencyStartNs = ewmaUpdate(mLatencyStartNs, latencyNs);
+
+	if (latencyNs > mLatencyStartMaxNs)
+		mLatencyStartMaxNs = latencyNs;
+}
+
+/*
+ * Telemetry
+ *
+ * Counters are owned by the worker. Once per interval, the
+ * worker publishes a snapshot to the broker. Readers only take
+ * the lock of the broker and never reference a worker. The
+ * queue depth is the number of processes taken over at the
+ * start of a round. Its maximum is kept for every interval.
+ */
+void ThreadPooling::statsUpdate(size_t depthQueue)
+{
+	PoolWorkerStats *pStats;
+	uint64_t intervalNs, busyNs, busyDiffNs;
+
+	mDepthQueueMax = PMAX(mDepthQueueMax, depthQueue);
+
+	intervalNs = duration_cast<nanoseconds>(mTickLast - mStatsLast).count();
+	if (intervalNs < (uint64_t)cMsIntervalStats * 1000000)
+		return;
+
+	busyNs = mBusyNs.load(memory_order_relaxed);
+	busyDiffNs = PMIN(busyNs - mBusyStatsNs, intervalNs);
+
+	mVecDepthQueue.push_back(PMIN(mDepthQueueMax, UINT32_MAX));
+	if (mVecDepthQueue.size() > cNumSamplesDepthQueue)
+		mVecDepthQueue.erase(mVecDepthQueue.begin());
+
+	{
+		Guard lock(mpPool->mMtxStats);
+		pStats = &mpPool->mVecStats[mIdxInternal];
+
+		pStats->numProcessing = mNumProcessing;
+		pStats->numFinished = mNumFinished;
+		pStats->finishedPerSec = (mNumFinished - mNumFinishedStats) * 1000000000 / intervalNs;
+		pStats->percentIdle = 100 - busyDiffNs * 100 / intervalNs;
+		pStats->latencyStartUs = mLatencyStartNs / 1000;
+		pStats->latencyStartMaxUs = mLatencyStartMaxNs / 1000;
+		pStats->vDepthQueue = mVecDepthQueue;
+		pStats->vHistTick = mHistTick;
+		pStats->numStolen = mNumStolen;
+		pStats->numMigratedIn = mNumMigratedIn;
+		pStats->numMigratedOut = mNumMigratedOut;
+	}
+
+	mStatsLast = mTickLast;
+	mNumFinishedStats = mNumFinished;
+	mBusyStatsNs = busyNs;
+	mLatencyStartMaxNs = 0;
+	mDepthQueueMax = 0;
+}
+
+void ThreadPooling::entryFromRequest(const PoolRequest &req, PoolEntry &entry, int32_t &idDriver,
+					const vector<uint64_t> *pVecLoads)
+{
+	entry.pProc = req.pProc;
+	entry.prio = req.prio;
+	entry.pinned = req.idDriverDesired >= 0 && req.idDriverDesired < mNumInternals;
+	entry.idNode = -1;
+	entry.costTickNs = 0;
+	entry.pCostType = NULL;
+	entry.vruntimeNs = 0;
+	entry.numOverruns = 0;
+	entry.offending = false;
+	entry.keyed = req.keyed;
+	entry.hashKey = req.hashKey;
+	entry.pCompletion = req.pCompletion;
+	entry.tSubmit = req.tSubmit;
+	entry.started = false;
+	entry.sleeping = false;
+	entry.deadlineWakeMs = 0;
+	entry.fdWake = -1;
+
+	if (req.keyed)
+	{
+		// Processes of a key must stay together
+		entry.pinned = true;
+		idDriver = idDriverKeyGet(req.hashKey);
+	}
+	else if (entry.pinned)
+		idDriver = req.idDriverDesired;
+	else
+		idDriver = idDriverNextGet(req.idNodeDesired, pVecLoads);
+
+	// Keep process on its node when stolen
+	if (req.idNodeDesired >= 0 &&
+			mVecInternals[idDriver]->mCpuGroup.idNode == req.idNodeDesired)
+		entry.idNode = req.idNodeDesired;
+}
+
+// Executed by submitter (any driver)
+bool ThreadPooling::procRingAdd(const PoolRequest &req)
+{
+	PoolEntry entry;
+	int32_t idDriver;
+
+	entryFromRequest(req, entry, idDriver);
+
+	return mVecInternals[idDriver]->procInternalPush(entry);
+}
+
+/*
+ * Batched submission
+ *
+ * All processes of a batch are placed in one pass. The loads
+ * of the workers are read once and updated locally with the
+ * estimated cost of each placed process. Afterwards, every
+ * worker gets its share under a single lock acquisition.
+ */
+void ThreadPooling::procsBatchAdd(const vector<PoolRequest> &vReqs)
+{
+	vector<PoolRequest>::const_iterator iter;
+	vector<PoolEntry>::const_iterator iEntry;
+	size_t numInternals = mNumInternals;
+	vector<vector<PoolEntry> > vLists(mVecInternals.size());
+	vector<uint64_t> vLoads(numInternals);
+	uint64_t costProcNs = PMAX(mCostProcNs.load(), 1);
+	PoolEntry entry;
+	PoolRequest req;
+	int32_t idDriver;
+	size_t i;
+
+	for (i = 0; i < numInternals; ++i)
+		vLoads[i] = mVecInternals[i]->loadGet();
+
+	iter = vReqs.begin();
+	for (; iter != vReqs.end(); ++iter)
+	{
+		entryFromRequest(*iter, entry, idDriver, &vLoads);
+		vLists[idDriver].push_back(entry);
+
+		if ((size_t)idDriver < vLoads.size())
+			vLoads[idDriver] += costProcNs;
+	}
+
+	for (i = 0; i < vLists.size(); ++i)
+	{
+		if (!vLists[i].size())
+			continue;
+
+		if (mVecInternals[i]->procsInternalAdd(vLists[i]))
+			continue;
+
+		// Worker is shutting down. Broker decides
+		iEntry = vLists[i].begin();
+		for (; iEntry != vLists[i].end(); ++iEntry)
+		{
+			req.pProc = iEntry->pProc;
+			req.idDriverDesired = -1;
+			req.idNodeDesired = iEntry->idNode;
+			req.prio = iEntry->prio;
+			req.keyed = iEntry->keyed;
+			req.hashKey = iEntry->hashKey;
+			req.pCompletion = iEntry->pCompletion;
+			req.tSubmit = iEntry->tSubmit;
+
+			mPpRequests.commit(req);
+		}
+	}
+}
+
+// Name may be reused by a new pool afterwards
+void ThreadPooling::poolUnregister()
+{
+	map<string, ThreadPooling *>::iterator iter;
+
+	if (!mNamePool.size())
+		return;
+
+	Guard lock(mtxPools);
+
+	iter = pools.find(mNamePool);
+	if (iter == pools.end() || iter->second != this)
+		return;
+
+	pools.erase(iter);
+}
+
+// Executed by submitter (any driver)
+void ThreadPooling::poolRequestAdd(const PoolRequest &req)
+{
+	bool ok = false;
+
+	++mNumSubmittersDirect;
+
+	if (mDirectEnabled)
+		ok = procRingAdd(req);
+
+	--mNumSubmittersDirect;
+
+	if (ok)
+		return;
+
+	mPpRequests.commit(req);
+}
+
+// Executed by submitter (any driver)
+bool ThreadPooling::procInternalPush(const PoolEntry &entry)
+{
+	// Count first. Worker may finish the process immediately
+	++mNumProcessing;
+
+	if (mRingProcsReq.push(entry))
+	{
+		wakeup();
+		return true;
+	}
+
+	--mNumProcessing;
+
+	return false;
+}
+
+// Executed by broker (different driver)
+void ThreadPooling::procInternalAdd(const PoolEntry &entry)
+{
+	{
+		Guard lock(mMtxBrokerInternal);
+		mVecProcsReq.push_back(entry);
+		++mNumProcessing;
+	}
+
+	wakeup();
+}
+
+// Executed by victim of work stealing or migration or by batch submitter (different driver)
+bool ThreadPooling::procsInternalAdd(vector<PoolEntry> &vEntries)
+{
+	size_t numEntries = vEntries.size();
+
+	{
+		Guard lock(mMtxBrokerInternal);
+
+		if (!mAcceptingWork)
+			return false;
+
+		mVecProcsReq.insert(mVecProcsReq.end(), vEntries.begin(), vEntries.end());
+		mNumProcessing += numEntries;
+	}
+
+	wakeup();
+
+	return true;
+}
+
+/*
+ * CPU pinning
+ *
+ * Every worker pins itself to the CPU group assigned by the
+ * broker. The groups are derived from the CPUs this program
+ * is allowed to run on. Optionally, memory is allocated on
+ * the NUMA node of the group.
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man3/pthread_setaffinity_np.3.html
+ * - https://man7.org/linux/man-pages/man2/sched_getaffinity.2.html
+ * - https://man7.org/linux/man-pages/man2/set_mempolicy.2.html
+ * - https://www.kernel.org/doc/Documentation/ABI/stable/sysfs-devices-system-cpu
+ */
+void ThreadPooling::cpuGroupsCreate(vector<PoolCpuGroup> &vGroups)
+{
+	vector<PoolCpu> vCpus;
+	vector<PoolCpu>::const_iterator iter;
+	vector<PoolCpuGroup>::iterator iGroup;
+	PoolCpuGroup group;
+
+	vGroups.clear();
+
+	if (mPinning == PinningNone)
+		return;
+
+	if (!cpusTopologyGet(vCpus))
+	{
+		procWrnLog("could not get CPU topology. Pinning disabled");
+		return;
+	}
+
+	iter = vCpus.begin();
+	for (; iter != vCpus.end(); ++iter)
+	{
+		iGroup = vGroups.begin();
+		for (; iGroup != vGroups.end(); ++iGroup)
+		{
+			const PoolCpu &cpuFirst = vCpus[iGroup->vIdCpus[0]];
+
+			if (mPinning == PinningPerCorePhysical &&
+					cpuFirst.idPackage == iter->idPackage &&
+					cpuFirst.idCore == iter->idCore)
+				break;
+
+			if (mPinning == PinningPerNode &&
+					cpuFirst.idNode == iter->idNode)
+				break;
+		}
+
+		// Index into vCpus for now
+		if (iGroup != vGroups.end())
+		{
+			iGroup->vIdCpus.push_back(iter - vCpus.begin());
+			continue;
+		}
+
+		group.vIdCpus.assign(1, iter - vCpus.begin());
+		group.idNode = iter->idNode;
+
+		vGroups.push_back(group);
+	}
+
+	iGroup = vGroups.begin();
+	for (; iGroup != vGroups.end(); ++iGroup)
+	{
+		for (size_t i = 0; i < iGroup->vIdCpus.size(); ++i)
+			iGroup->vIdCpus[i] = vCpus[iGroup->vIdCpus[i]].idCpu;
+	}
+
+	procDbgLog("created %zu CPU groups", vGroups.size());
+}
+
+// Executed by worker
+bool ThreadPooling::cpusPin()
+{
+#if defined(__linux__)
+	vector<uint16_t>::const_iterator iter;
+	cpu_set_t setCpus;
+	unsigned long maskNodes;
+	int res;
+
+	CPU_ZERO(&setCpus);
+
+	iter = mCpuGroup.vIdCpus.begin();
+	for (; iter != mCpuGroup.vIdCpus.end(); ++iter)
+		CPU_SET(*iter, &setCpus);
+
+	res = pthread_setaffinity_np(pthread_self(), sizeof(setCpus), &setCpus);
+	if (res)
+	{
+		procErrLog(-1, "could not set CPU affinity: %s (%d)", strerror(res), res);
+		return false;
+	}
+
+	if (!mpPool->mMemNodeLocal)
+		return true;
+
+	if (mCpuGroup.idNode < 0 || mCpuGroup.idNode >= (int32_t)sizeof(maskNodes) * 8)
+		return true;
+
+	maskNodes = 1UL << mCpuGroup.idNode;
+
+	// MPOL_PREFERRED = 1. Avoids dependency to libnuma
+	res = syscall(SYS_set_mempolicy, 1, &maskNodes, sizeof(maskNodes) * 8);
+	if (res)
+		procWrnLog("could not set memory policy: %s (%d)", strerror(errno), errno);
+
+	return true;
+#else
+	procWrnLog("CPU pinning not supported on this platform");
+	return false;
+#endif
+}
+
+/*
+ * Idle parking
+ *
+ * A worker without processes blocks until new work arrives.
+ * Producers only signal the worker if it is actually parked.
+ * The flag and the queues are checked in opposite order by
+ * the worker and the producers (Dekker). Therefore at least
+ * one of them sees the other.
+ *
+ * Literature
+ * - https://man7.org/linux/man-pages/man2/eventfd.2.html
+ * - https://man7.org/linux/man-pages/man2/poll.2.html
+ * - https://en.cppreference.com/w/cpp/thread/condition_variable/wait_for
+ */
+bool ThreadPooling::wakeupInit()
+{
+#if defined(__linux__)
+	mFdWakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (mFdWakeup < 0)
+	{
+		procErrLog(-1, "could not create eventfd: %s (%d)", strerror(errno), errno);
+		return false;
+	}
+#endif
+	return true;
+}
+
+void ThreadPooling::idlePark()
+{
+	uint32_t msPark = cMsIdleParkMax;
+	int32_t msSleep;
+
+	if (mpPool->mWorkStealing)
+		msPark = cMsIdleParkStealing;
+
+	// Wake up with the earliest sleeping process
+	if (mNumSleeping)
+	{
+		msSleep = mDeadlineNextMs - millis();
+		if (msSleep <= 0)
+			return;
+
+		msPark = PMIN(msPark, (uint32_t)msSleep);
+	}
+
+	mParked = true;
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (mParkingDisabled || mRingProcsReq.size())
+	{
+		mParked = false;
+		return;
+	}
+
+	{
+		Guard lock(mMtxBrokerInternal);
+
+		if (mVecProcsReq.size())
+		{
+			mParked = false;
+			return;
+		}
+	}
+#if defined(__linux__)
+	vector<int>::iterator iter;
+	struct pollfd pfd;
+	eventfd_t val;
+
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	pfd.fd = mFdWakeup;
+	mVecPollFds.assign(1, pfd);
+
+	// Sleeping processes waiting for an fd
+	iter = mVecFdsSleep.begin();
+	for (; iter != mVecFdsSleep.end(); ++iter)
+	{
+		pfd.fd = *iter;
+		mVecPollFds.push_back(pfd);
+	}
+
+	if (::poll(mVecPollFds.data(), mVecPollFds.size(), msPark) > 0 &&
+			mVecPollFds[0].revents)
+		eventfd_read(mFdWakeup, &val);
+#else
+	{
+		unique_lock<mutex> lock(mMtxPark);
+
+		mCondPark.wait_for(lock, chrono::milliseconds(msPark),
+					[this] { return mWakeupReq; });
+		mWakeupReq = false;
+	}
+#endif
+	mParked = false;
+}
+
+// Executed by any driver
+void ThreadPooling::wakeup()
+{
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (!mParked)
+		return;
+#if defined(__linux__)
+	eventfd_write(mFdWakeup, 1);
+#else
+	{
+		Guard lock(mMtxPark);
+		mWakeupReq = true;
+	}
+
+	mCondPark.notify_one();
+#endif
+}
+
+/*
+ * Wakeup hints
+ *
+ * A pooled process may tell its worker when it needs the next
+ * tick. Until then, the process is skipped. Hints are only
+ * accepted for the root of a pooled process tree while it is
+ * ticked. Sleeping is limited so cancellations take effect.
+ * When every process of a worker is sleeping, an idle worker
+ * parks until the earliest deadline or until an fd of a
+ * sleeping process is readable.
+ */
+bool ThreadPooling::wakeupSet(Processing *pProc, uint32_t deadlineMs, int fd)
+{
+	ThreadPooling *pInternal = pInternalTicking;
+
+	if (!pInternal || pInternal->mpProcTicking != pProc)
+		return false;
+#if !defined(__linux__)
+	// Parking can't wait for file descriptors here
+	if (fd >= 0)
+		return false;
+#endif
+	pInternal->mWakeupHint = true;
+	pInternal->mDeadlineHintMs = deadlineMs;
+	pInternal->mFdHint = fd;
+
+	return true;
+}
+
+bool ThreadPooling::entryAwake(PoolEntry &entry)
+{
+	bool awake;
+
+	awake = (int32_t)(mMsRound - entry.deadlineWakeMs) >= 0;
+
+	if (!awake && entry.fdWake >= 0)
+		awake = binary_search(mVecFdsReady.begin(), mVecFdsReady.end(), entry.fdWake);
+
+	if (!awake)
+		return false;
+
+	entry.sleeping = false;
+	entry.fdWake = -1;
+
+	return true;
+}
+
+void ThreadPooling::entrySleep(PoolEntry &entry)
+{
+	uint32_t deadlineMaxMs = mMsRound + cMsSleepMax;
+
+	if ((int32_t)(mDeadlineHintMs - mMsRound) <= 0)
+		return;
+
+	entry.sleeping = true;
+	entry.deadlineWakeMs = mDeadlineHintMs;
+	entry.fdWake = mFdHint;
+
+	if ((int32_t)(entry.deadlineWakeMs - deadlineMaxMs) > 0)
+		entry.deadlineWakeMs = deadlineMaxMs;
+
+	sleepAccount(entry);
+}
+
+void ThreadPooling::sleepAccount(const PoolEntry &entry)
+{
+	if (!mNumSleeping || (int32_t)(entry.deadlineWakeMs - mDeadlineNextMs) < 0)
+		mDeadlineNextMs = entry.deadlineWakeMs;
+
+	++mNumSleeping;
+
+	if (entry.fdWake < 0)
+		return;
+
+	mVecFdsSleep.push_back(entry.fdWake);
+}
+
+// Fds of the last round. No blocking
+void ThreadPooling::fdsSleepPoll()
+{
+	mVecFdsReady.clear();
+#if defined(__linux__)
+	vector<int>::iterator iter;
+	struct pollfd pfd;
+	size_t i;
+
+	if (!mVecFdsSleep.size())
+		return;
+
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	mVecPollFds.clear();
+
+	iter = mVecFdsSleep.begin();
+	for (; iter != mVecFdsSleep.end(); ++iter)
+	{
+		pfd.fd = *iter;
+		mVecPollFds.push_back(pfd);
+	}
+
+	mVecFdsSleep.clear();
+
+	if (::poll(mVecPollFds.data(), mVecPollFds.size(), 0) <= 0)
+		return;
+
+	for (i = 0; i < mVecPollFds.size(); ++i)
+	{
+		if (mVecPollFds[i].revents)
+			mVecFdsReady.push_back(mVecPollFds[i].fd);
+	}
+
+	sort(mVecFdsReady.begin(), mVecFdsReady.end());
+#endif
+}
+
+void ThreadPooling::procAdd(Processing *pProc, int32_t idDriver)
+{
+	procAdd(pProc, PrioNormal, idDriver);
+}
+
+void ThreadPooling::procAdd(Processing *pProc, PoolPriority prio, int32_t idDriver)
+{
+	PoolRequest req;
+
+	req.pProc = pProc;
+	req.idDriverDesired = idDriver;
+	req.idNodeDesired = -1;
+	req.prio = prio;
+	req.keyed = false;
+	req.hashKey = 0;
+	req.pCompletion = NULL;
+	req.tSubmit = steady_clock::now();
+
+	procRequestAdd(req);
+}
+
+void ThreadPooling::procAdd(Processing *pProc, const string &keyAffinity, PoolPriority prio)
+{
+	PoolRequest req;
+
+	req.pProc = pProc;
+	req.idDriverDesired = -1;
+	req.idNodeDesired = -1;
+	req.prio = prio;
+	req.keyed = true;
+	req.hashKey = hashFnv(keyAffinity.data(), keyAffinity.size());
+	req.pCompletion = NULL;
+	req.tSubmit = steady_clock::now();
+
+	procRequestAdd(req);
+}
+
+void ThreadPooling::procAdd(Processing *pProc, PoolCompletion *pCompletion, PoolPriority prio)
+{
+	PoolRequest req;
+
+	req.pProc = pProc;
+	req.idDriverDesired = -1;
+	req.idNodeDesired = -1;
+	req.prio = prio;
+	req.keyed = false;
+	req.hashKey = 0;
+	req.pCompletion = pCompletion;
+	req.tSubmit = steady_clock::now();
+
+	procRequestAdd(req);
+}
+
+bool ThreadPooling::procAdd(const char *pNamePool, Processing *pProc, PoolPriority prio)
+{
+	map<string, ThreadPooling *>::iterator iter;
+
+	// Pool must not be destroyed in the meantime
+	Guard lock(mtxPools);
+
+	iter = pools.find(pNamePool);
+	if (iter == pools.end())
+	{
+		errLog(-1, "thread pool '%s' not found", pNamePool);
+		return false;
+	}
+
+	procAdd(iter->second, pProc, prio);
+
+	return true;
+}
+
+void ThreadPooling::procAdd(ThreadPooling *pPool, Processing *pProc, PoolPriority prio)
+{
+	PoolRequest req;
+
+	req.pProc = pProc;
+	req.idDriverDesired = -1;
+	req.idNodeDesired = -1;
+	req.prio = prio;
+	req.keyed = false;
+	req.hashKey = 0;
+	req.pCompletion = NULL;
+	req.tSubmit = steady_clock::now();
+
+	pPool->poolRequestAdd(req);
+}
+
+void ThreadPooling::procAddBatch(const vector<Processing *> &vProcs, PoolPriority prio)
+{
+	vector<Processing *>::const_iterator iter;
+	vector<PoolRequest> vReqs;
+	vector<PoolRequest>::const_iterator iReq;
+	PoolRequest req;
+
+	req.idDriverDesired = -1;
+	req.idNodeDesired = -1;
+	req.prio = prio;
+	req.keyed = false;
+	req.hashKey = 0;
+	req.pCompletion = NULL;
+	req.tSubmit = steady_clock::now();
+
+	vReqs.reserve(vProcs.size());
+
+	iter = vProcs.begin();
+	for (; iter != vProcs.end(); ++iter)
+	{
+		req.pProc = *iter;
+		vReqs.push_back(req);
+	}
+
+	if (procsDirectAdd(vReqs))
+		return;
+
+	dbgLog("adding %zu procs to queue", vReqs.size());
+
+	iReq = vReqs.begin();
+	for (; iReq != vReqs.end(); ++iReq)
+		ppPoolRequests.commit(*iReq);
+}
+
+void ThreadPooling::procNodeAdd(Processing *pProc, uint16_t idNode, PoolPriority prio)
+{
+	PoolRequest req;
+
+	req.pProc = pProc;
+	req.idDriverDesired = -1;
+	req.idNodeDesired = idNode;
+	req.prio = prio;
+	req.keyed = false;
+	req.hashKey = 0;
+	req.pCompletion = NULL;
+	req.tSubmit = steady_clock::now();
+
+	procRequestAdd(req);
+}
+
+void ThreadPooling::processInfo(char *pBuf, char *pBufEnd)
+{
+	map<const char *, PoolCostType>::const_iterator iType;
+	vector<PoolWorkerStats>::const_iterator iStats;
+	const char *pName;
+	PoolWorkerStats stats;
+	PoolStats statsPool;
+	uint64_t boundUs = cNsBoundHistTickFirst / 1000;
+	size_t numFinished = 0;
+	uint32_t finishedPerSec = 0, percentIdle = 0;
+	char bufBin[24];
+#if 0
+	dInfo("State\t\t\t%s\n", ProcStateString[mState]);
+	dInfo("State shutdown\t\t%s\n", SdStateString[mStateSd]);
+#endif
+	if (!mIsInternal)
+	{
+		if (mNamePool.size())
+			dInfo("Pool\t\t\t%s\n", mNamePool.c_str());
+		if (mCntInternalsMax)
+			dInfo("Workers\t\t\t%u (%u..%u)\n", mNumInternals.load(),
+					mCntInternalsMin, mCntInternalsMax);
+
+		statsGet(statsPool);
+		if (!statsPool.vWorkers.size())
+			return;
+
+		iStats = statsPool.vWorkers.begin();
+		for (; iStats != statsPool.vWorkers.end(); ++iStats)
+		{
+			numFinished += iStats->numFinished;
+			finishedPerSec += iStats->finishedPerSec;
+			percentIdle += iStats->percentIdle;
+		}
+
+		dInfo("Finished\t\t%zu (%u/s)\n", numFinished, finishedPerSec);
+		dInfo("Idle\t\t\t%zu%%\n", percentIdle / statsPool.vWorkers.size());
+
+		return;
+	}
+
+	{
+		Guard lock(mpPool->mMtxStats);
+		stats = mpPool->mVecStats[mIdxInternal];
+	}
+
+	if (mCpuGroup.vIdCpus.size())
+	{
+		dInfo("CPUs\t\t\t");
+		for (size_t i = 0; i < mCpuGroup.vIdCpus.size(); ++i)
+			dInfo("%s%u", i ? "," : "", mCpuGroup.vIdCpus[i]);
+		dInfo(" (node %d)\n", mCpuGroup.idNode);
+	}
+
+	dInfo("Processing\t\t%zu\n", mNumProcessing.load());
+	dInfo("Finished\t\t%zu (%u/s)\n", stats.numFinished, stats.finishedPerSec);
+	dInfo("Idle\t\t\t%u%%\n", stats.percentIdle);
+	dInfo("Latency start\t\t%.3fms (max %.3fms)\n",
+			stats.latencyStartUs / 1000.0, stats.latencyStartMaxUs / 1000.0);
+
+	dInfo("Queue depth\t\t");
+	for (size_t i = 0; i < stats.vDepthQueue.size(); ++i)
+		dInfo("%s%u", i ? " " : "", stats.vDepthQueue[i]);
+	dInfo("\n");
+
+	dInfo("Cost round\t\t%.3fms\n", mCostRoundNs / 1000000.0);
+
+	dInfo("Tick duration\n");
+	for (size_t i = 0; i < stats.vHistTick.size(); ++i, boundUs <<= 2)
+	{
+		if (i < stats.vHistTick.size() - 1)
+			snprintf(bufBin, sizeof(bufBin), "< %" PRIu64 "us", boundUs);
+		else
+			snprintf(bufBin, sizeof(bufBin), ">= %" PRIu64 "us", boundUs >> 2);
+
+		dInfo("  %-22s%" PRIu64 "\n", bufBin, stats.vHistTick[i]);
+	}
+
+	{
+		Guard lock(mMtxCostTypes);
+
+		iType = mCostTypes.begin();
+		for (; iType != mCostTypes.end(); ++iType)
+		{
+			pName = iType->first;
+
+			// Skip length prefix of mangled names
+			while (*pName >= '0' && *pName <= '9')
+				++pName;
+
+			dInfo("  %-22s%.3fms (%zu ticks)\n", pName,
+					iType->second.costTickNs / 1000000.0,
+					iType->second.numTicks);
+
+			if (!iType->second.numOverruns)
+				continue;
+
+			dInfo("    Over budget\t\t%zu (max %.3fms)\n",
+					iType->second.numOverruns,
+					iType->second.costTickMaxNs / 1000000.0);
+		}
+	}
+
+	if (mpPool->mIntervalRebalanceMs)
+	{
+		dInfo("Migrated in\t\t%zu\n", mNumMigratedIn.load());
+		dInfo("Migrated out\t\t%zu\n", mNumMigratedOut.load());
+	}
+
+	if (!mpPool->mWorkStealing)
+		return;
+
+	dInfo("Stolen\t\t\t%zu\n", mNumStolen.load());
+}
+
+/* static functions */
+
+/*
+ * Named pools
+ *
+ * Every pool has its own submission queue, workers and driver
+ * factory. Named pools are registered by name and only serve
+ * submissions addressed to them. Unnamed pools serve the
+ * default submissions as well.
+ */
+ThreadPooling *ThreadPooling::create(const char *pName)
+{
+	ThreadPooling *pPool;
+
+	if (!pName || !*pName)
+		return create();
+
+	Guard lock(mtxPools);
+
+	if (pools.find(pName) != pools.end())
+	{
+		errLog(-1, "thread pool '%s' exists already", pName);
+		return NULL;
+	}
+
+	pPool = create();
+	if (!pPool)
+		return NULL;
+
+	pPool->mNamePool = pName;
+	pools[pName] = pPool;
+
+	return pPool;
+}
+
+ThreadPooling *ThreadPooling::poolGet(const char *pName)
+{
+	map<string, ThreadPooling *>::iterator iter;
+
+	Guard lock(mtxPools);
+
+	iter = pools.find(pName);
+	if (iter == pools.end())
+		return NULL;
+
+	return iter->second;
+}
+
+void ThreadPooling::procRequestAdd(const PoolRequest &req)
+{
+	if (procDirectAdd(req))
+		return;
+
+	dbgLog("adding proc %p to queue", req.pProc);
+	ppPoolRequests.commit(req);
+}
+
+const char *ThreadPooling::typeNameGet(Processing *pProc)
+{
+#if defined(__GXX_RTTI) || defined(_CPPRTTI)
+	return typeid(*pProc).name();
+#else
+	(void)pProc;
+	return "Processing";
+#endif
+}
+
+uint32_t ThreadPooling::ewmaUpdate(uint32_t ewma, uint32_t val)
+{
+	// alpha = 1/8
+	return ewma - (ewma >> 3) + (val >> 3);
+}
+
+// FNV-1a with finalizer of MurmurHash3
+uint32_t ThreadPooling::hashFnv(const void *pData, size_t len)
+{
+	const uint8_t *pByte = (const uint8_t *)pData;
+	uint32_t hash = cHashFnvOffset;
+
+	for (; len; --len, ++pByte)
+	{
+		hash ^= *pByte;
+		hash *= cHashFnvPrime;
+	}
+
+	// Avalanche. Short inputs are spread poorly otherwise
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+bool ThreadPooling::cpusTopologyGet(vector<PoolCpu> &vCpus)
+{
+#if defined(__linux__)
+	cpu_set_t setCpus;
+	PoolCpu cpu;
+	string pathCpu;
+	struct dirent *pEntry;
+	DIR *pDir;
+	FILE *pFile;
+	int idCpu;
+
+	vCpus.clear();
+	CPU_ZERO(&setCpus);
+
+	if (sched_getaffinity(0, sizeof(setCpus), &setCpus))
+		return false;
+
+	for (idCpu = 0; idCpu < CPU_SETSIZE; ++idCpu)
+	{
+		if (!CPU_ISSET(idCpu, &setCpus))
+			continue;
+
+		pathCpu = "/sys/devices/system/cpu/cpu" + to_string(idCpu);
+
+		cpu.idCpu = idCpu;
+		cpu.idCore = idCpu;
+		cpu.idPackage = 0;
+		cpu.idNode = 0;
+
+		pFile = fopen((pathCpu + "/topology/core_id").c_str(), "r");
+		if (pFile)
+		{
+			if (fscanf(pFile, "%d", &cpu.idCore) != 1)
+				cpu.idCore = idCpu;
+			fclose(pFile);
+		}
+
+		pFile = fopen((pathCpu + "/topology/physical_package_id").c_str(), "r");
+		if (pFile)
+		{
+			if (fscanf(pFile, "%d", &cpu.idPackage) != 1)
+				cpu.idPackage = 0;
+			fclose(pFile);
+		}
+
+		// Entry 'nodeN' exists on NUMA systems only
+		pDir = opendir(pathCpu.c_str());
+		while (pDir && (pEntry = readdir(pDir)))
+		{
+			if (strncmp(pEntry->d_name, "node", 4))
+				continue;
+
+			if (sscanf(pEntry->d_name + 4, "%d", &cpu.idNode) == 1)
+				break;
+		}
+
+		if (pDir)
+			closedir(pDir);
+
+		vCpus.push_back(cpu);
+	}
+
+	return vCpus.size() > 0;
+#else
+	(void)vCpus;
+	return false;
+#endif
+}
+
+/*
+ * Direct submission
+ *
+ * Bypasses the broker and writes the request straight into
+ * the queue of the selected worker. The broker waits for
+ * pending direct submitters before it stops the workers.
+ * Falls back to the broker if no pool is running or if the
+ * queue of the worker is full.
+ */
+bool ThreadPooling::procDirectAdd(const PoolRequest &req)
+{
+	ThreadPooling *pPool;
+	bool ok = false;
+
+	++numSubmittersDirect;
+
+	pPool = pPoolDirect;
+	if (pPool)
+		ok = pPool->procRingAdd(req);
+
+	--numSubmittersDirect;
+
+	if (ok)
+		dbgLog("added proc %p directly", req.pProc);
+
+	return ok;
+}
+
+bool ThreadPooling::procsDirectAdd(const vector<PoolRequest> &vReqs)
+{
+	ThreadPooling *pPool;
+
+	if (!vReqs.size())
+		return true;
+
+	++numSubmittersDirect;
+
+	pPool = pPoolDirect;
+	if (pPool)
+		pPool->procsBatchAdd(vReqs);
+
+	--numSubmittersDirect;
+
+	if (pPool)
+		dbgLog("added %zu procs directly", vReqs.size());
+
+	return pPool != NULL;
+}
+
+/*
+ * Completion handles
+ *
+ * Owned by the submitter. Must exist until the process is
+ * finished. The callback is executed by the worker before
+ * the process is undriven. Therefore the process is still
+ * valid inside of the callback.
+ */
+PoolCompletion::PoolCompletion(FuncPoolDone pFctDone, void *pUser)
+	: mpFctDone(pFctDone)
+	, mpUser(pUser)
+	, mDone(false)
+	, mSuccess(Pending)
+	, mMtxDone()
+	, mCondDone()
+{}
+
+// Lock needed. Owner may destroy the handle right afterwards
+bool PoolCompletion::done() const
+{
+	Guard lock(mMtxDone);
+	return mDone;
+}
+
+Success PoolCompletion::success() const
+{
+	Guard lock(mMtxDone);
+	return mSuccess;
+}
+
+bool PoolCompletion::wait(uint32_t timeoutMs)
+{
+	unique_lock<mutex> lock(mMtxDone);
+
+	return mCondDone.wait_for(lock, chrono::milliseconds(timeoutMs),
+					[this] { return mDone; });
+}
+
+// Executed by worker
+void PoolCompletion::finish(Success success)
+{
+	Guard lock(mMtxDone);
+
+	mSuccess = success;
+	mDone = true;
+
+	mCondDone.notify_all();
+}
 
@@ -26,19 +26,176 @@
 #ifndef THREAD_POOLING_H
 #define THREAD_POOLING_H
 
+#include <string>
 #include <vector>
-#include <list>
+#include <map>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#if defined(__linux__)
+#include <poll.h>
+#endif
 
 #include "Processing.h"
 #include "Pipe.h"
+#include "RingMpsc.h"
 
 typedef void (*FuncDriverPoolCreate)(Processing *pProc, uint16_t idProc);
+typedef void (*FuncPoolDone)(Processing *pProc, Success success, void *pUser);
+
+enum PoolPinning
+{
+	PinningNone = 0,
+	PinningPerCore,
+	PinningPerCorePhysical,
+	PinningPerNode,
+};
+
+enum PoolPriority
+{
+	PrioCritical = 0,
+	PrioNormal,
+	PrioBulk,
+};
+
+class PoolCompletion
+{
+
+public:
+
+	PoolCompletion(FuncPoolDone pFctDone = NULL, void *pUser = NULL);
+	virtual ~PoolCompletion() {}
+
+	bool done() const;
+	Success success() const;
+	bool wait(uint32_t timeoutMs);
+
+private:
+
+	PoolCompletion(const PoolCompletion &) = delete;
+	PoolCompletion &operator=(const PoolCompletion &) = delete;
+
+	friend class ThreadPooling;
+
+	void finish(Success success);
+
+	FuncPoolDone mpFctDone;
+	void *mpUser;
+	bool mDone;
+	Success mSuccess;
+	mutable std::mutex mMtxDone;
+	std::condition_variable mCondDone;
+
+};
 
 struct PoolRequest
 {
 	Processing *pProc;
 	int32_t idDriverDesired;
+	int32_t idNodeDesired;
+	PoolPriority prio;
+	bool keyed;
+	uint32_t hashKey;
+	PoolCompletion *pCompletion;
+	std::chrono::steady_clock::time_point tSubmit;
+};
+
+struct PoolCostType
+{
+	PoolCostType()
+		: costTickNs(0)
+		, costTickMaxNs(0)
+		, numTicks(0)
+		, numOverruns(0)
+	{}
+	uint32_t costTickNs;
+	uint32_t costTickMaxNs;
+	size_t numTicks;
+	size_t numOverruns;
+};
+
+struct PoolEntry
+{
+	Processing *pProc;
+	PoolPriority prio;
+	bool pinned;
+	int32_t idNode;
+	uint32_t costTickNs;
+	PoolCostType *pCostType;
+	uint64_t vruntimeNs;
+	uint32_t numOverruns;
+	bool offending;
+	bool keyed;
+	uint32_t hashKey;
+	PoolCompletion *pCompletion;
+	std::chrono::steady_clock::time_point tSubmit;
+	bool started;
+	bool sleeping;
+	uint32_t deadlineWakeMs;
+	int fdWake;
+};
+
+struct PoolWorkerStats
+{
+	PoolWorkerStats()
+		: idWorker(0)
+		, numProcessing(0)
+		, numFinished(0)
+		, finishedPerSec(0)
+		, percentIdle(100)
+		, latencyStartUs(0)
+		, latencyStartMaxUs(0)
+		, vDepthQueue()
+		, vHistTick()
+		, numStolen(0)
+		, numMigratedIn(0)
+		, numMigratedOut(0)
+	{}
+	uint16_t idWorker;
+	size_t numProcessing;
+	size_t numFinished;
+	uint32_t finishedPerSec;
+	uint32_t percentIdle;
+	uint32_t latencyStartUs;
+	uint32_t latencyStartMaxUs;
+	std::vector<uint32_t> vDepthQueue;
+	std::vector<uint64_t> vHistTick;
+	size_t numStolen;
+	size_t numMigratedIn;
+	size_t numMigratedOut;
+};
+
+struct PoolStats
+{
+	std::string namePool;
+	uint16_t numWorkers;
+	std::vector<uint32_t> vBoundsHistUs;
+	std::vector<PoolWorkerStats> vWorkers;
+};
+
+struct PoolHashNode
+{
+	uint32_t hash;
+	uint16_t idDriver;
+};
+
+struct PoolCpu
+{
+	uint16_t idCpu;
+	int32_t idCore;
+	int32_t idPackage;
+	int32_t idNode;
+};
+
+struct PoolCpuGroup
+{
+	PoolCpuGroup()
+		: vIdCpus()
+		, idNode(-1)
+	{}
+	std::vector<uint16_t> vIdCpus;
+	int32_t idNode;
 };
 
 class ThreadPooling : public Processing
@@ -51,14 +208,35 @@ public:
 		return new dNoThrow ThreadPooling;
 	}
 
+	static ThreadPooling *create(const char *pName);
+	static ThreadPooling *poolGet(const char *pName);
+
 	void workerCntSet(uint16_t cnt);
+	void workerCntRangeSet(uint16_t cntMin, uint16_t cntMax);
 	void driverCreateSet(FuncDriverPoolCreate pFctDriverCreate);
+	void workStealingSet(bool en);
+	void sizeQueueSet(uint32_t size);
+	void idleParkingSet(bool en);
+	void pinningSet(PoolPinning pinning, bool memNodeLocal = false);
+	void rebalanceIntervalSet(uint32_t intervalMs);
+	void tickBudgetSet(uint32_t budgetUs);
+
+	void statsGet(PoolStats &stats);
 
 	static void procAdd(Processing *pProc, int32_t idDriver = -1);
+	static void procAdd(Processing *pProc, PoolPriority prio, int32_t idDriver = -1);
+	static void procAdd(Processing *pProc, const std::string &keyAffinity, PoolPriority prio = PrioNormal);
+	static void procAdd(Processing *pProc, PoolCompletion *pCompletion, PoolPriority prio = PrioNormal);
+	static void procAddBatch(const std::vector<Processing *> &vProcs, PoolPriority prio = PrioNormal);
+	static bool procAdd(const char *pNamePool, Processing *pProc, PoolPriority prio = PrioNormal);
+	static void procAdd(ThreadPooling *pPool, Processing *pProc, PoolPriority prio = PrioNormal);
+	static void procNodeAdd(Processing *pProc, uint16_t idNode, PoolPriority prio = PrioNormal);
+
+	static bool wakeupSet(Processing *pProc, uint32_t deadlineMs, int fd = -1);
 
 protected:
 
-	virtual ~ThreadPooling() {}
+	virtual ~ThreadPooling();
 
 private:
 
@@ -76,32 +254,160 @@ private:
 	Success shutdown();
 	void processInfo(char *pBuf, char *pBufEnd);
 
-	void poolRequestsProcess();
+	void poolRequestsProcess(Pipe<PoolRequest> &ppRequests);
+	void poolRequestAdd(const PoolRequest &req);
+	void poolUnregister();
+	bool workerAdd(uint16_t idx);
+	void workersScale();
+	void workerRetire();
+	void procsRetire();
+	size_t procsKeyedHandOver();
 	void procsDrive();
-	int32_t idDriverNextGet();
+	void procsTick(PoolPriority prio, uint64_t &costRoundNs);
+	size_t numEntriesGet();
+	void entryFinish(PoolEntry &entry);
+	int32_t idDriverNextGet(int32_t idNode = -1, const std::vector<uint64_t> *pVecLoads = NULL);
+	void hashNodesCreate();
+	int32_t idDriverKeyGet(uint32_t hashKey);
 	size_t numProcessingGet();
-	void procInternalAdd(Processing *pProc);
+	uint64_t loadGet();
+	void entryIntake(PoolEntry &entry);
+	void costRecord(PoolEntry &entry, uint32_t costNs);
+	void latencyStartRecord(PoolEntry &entry);
+	void statsUpdate(size_t depthQueue);
+	void entryFromRequest(const PoolRequest &req, PoolEntry &entry, int32_t &idDriver,
+					const std::vector<uint64_t> *pVecLoads = NULL);
+	bool procRingAdd(const PoolRequest &req);
+	void procsBatchAdd(const std::vector<PoolRequest> &vReqs);
+	bool procInternalPush(const PoolEntry &entry);
+	void procInternalAdd(const PoolEntry &entry);
+	bool procsInternalAdd(std::vector<PoolEntry> &vEntries);
+	void procsSteal();
+	void procsDonate();
+	void procsRebalance();
+	void procsMigrate();
+	size_t procsHandOver(ThreadPooling *pTarget, size_t numMax, uint64_t costMaxNs);
+	void cpuGroupsCreate(std::vector<PoolCpuGroup> &vGroups);
+	bool cpusPin();
+	bool wakeupInit();
+	void idlePark();
+	void wakeup();
+	bool entryAwake(PoolEntry &entry);
+	void entrySleep(PoolEntry &entry);
+	void sleepAccount(const PoolEntry &entry);
+	void fdsSleepPoll();
 
 	/* member variables */
 	uint32_t mStateSd;
 
 	// Broker
+	std::string mNamePool;
+	Pipe<PoolRequest> mPpRequests;
+	std::atomic<bool> mDirectEnabled;
+	std::atomic<size_t> mNumSubmittersDirect;
 	uint16_t mCntInternals;
+	uint16_t mCntInternalsMin;
+	uint16_t mCntInternalsMax;
+	std::atomic<uint16_t> mNumInternals;
 	std::vector<ThreadPooling *> mVecInternals;
+	std::vector<PoolCpuGroup> mCpuGroups;
+	std::vector<PoolHashNode> mVecHashNodes;
 	FuncDriverPoolCreate mpFctDriverCreate;
+	bool mWorkStealing;
+	uint32_t mSizeQueue;
+	bool mIdleParking;
+	PoolPinning mPinning;
+	bool mMemNodeLocal;
+	std::atomic<bool> mInternalsStarted;
+	std::atomic<uint32_t> mCostProcNs;
+	uint32_t mIntervalRebalanceMs;
+	uint32_t mStartRebalanceMs;
+	uint32_t mBudgetTickNs;
+	uint32_t mStartScaleMs;
+	uint32_t mNumScalesIdle;
+	uint32_t mStateRetire;
+	ThreadPooling *mpRetiring;
+	std::vector<size_t> mVecRoundsRetire;
+	std::vector<PoolWorkerStats> mVecStats;
+	std::mutex mMtxStats;
 
 	// Internal
 	bool mIsInternal;
-	size_t mNumProcessing;
+	ThreadPooling *mpPool;
+	uint16_t mIdxInternal;
+	PoolCpuGroup mCpuGroup;
+	std::atomic<size_t> mNumProcessing;
+	std::atomic<size_t> mNumDriven;
+	std::atomic<uint32_t> mCostRoundNs;
+	std::atomic<uint64_t> mBusyNs;
+	uint64_t mBusyScaleNs;
+	std::atomic<size_t> mNumRounds;
+	std::map<const char *, PoolCostType> mCostTypes;
+	std::mutex mMtxCostTypes;
 	size_t mNumFinished;
-	std::list<Processing *> mListProcsReq;
-	std::list<Processing *> mListProcs;
+	std::atomic<size_t> mNumStolen;
+	std::atomic<size_t> mNumMigratedIn;
+	std::atomic<size_t> mNumMigratedOut;
+	bool mAcceptingWork;
+	RingMpsc<PoolEntry> mRingProcsReq;
+	std::vector<PoolEntry> mVecProcsReq;
+	std::vector<PoolEntry> mVecProcsIntake;
+	std::vector<PoolEntry> mVecProcs[PrioBulk + 1];
+	size_t mIdxBulkNext;
 	std::mutex mMtxBrokerInternal;
+	std::chrono::steady_clock::time_point mTickLast;
+	std::chrono::steady_clock::time_point mTickCriticalLast;
+	std::chrono::steady_clock::time_point mStatsLast;
+	size_t mNumFinishedStats;
+	uint64_t mBusyStatsNs;
+	uint32_t mLatencyStartNs;
+	uint32_t mLatencyStartMaxNs;
+	size_t mDepthQueueMax;
+	std::vector<uint32_t> mVecDepthQueue;
+	std::vector<uint64_t> mHistTick;
+	uint64_t mVruntimeMinNs;
+	uint64_t mVruntimeRoundNs;
+	std::atomic<int32_t> mIdxThief;
+	std::atomic<bool> mStealPending;
+	std::atomic<int32_t> mIdxMigrationTarget;
+	std::atomic<uint64_t> mCostMigrationNs;
+	std::atomic<bool> mParked;
+	std::atomic<bool> mParkingDisabled;
+	Processing *mpProcTicking;
+	bool mWakeupHint;
+	uint32_t mDeadlineHintMs;
+	int mFdHint;
+	uint32_t mMsRound;
+	bool mTickNested;
+	size_t mNumSleeping;
+	uint32_t mDeadlineNextMs;
+	std::vector<int> mVecFdsSleep;
+	std::vector<int> mVecFdsReady;
+#if defined(__linux__)
+	int mFdWakeup;
+	std::vector<struct pollfd> mVecPollFds;
+#else
+	std::mutex mMtxPark;
+	std::condition_variable mCondPark;
+	bool mWakeupReq;
+#endif
 
 	/* static functions */
+	static void procRequestAdd(const PoolRequest &req);
+	static bool procDirectAdd(const PoolRequest &req);
+	static bool procsDirectAdd(const std::vector<PoolRequest> &vReqs);
+	static bool cpusTopologyGet(std::vector<PoolCpu> &vCpus);
+	static const char *typeNameGet(Processing *pProc);
+	static uint32_t ewmaUpdate(uint32_t ewma, uint32_t val);
+	static uint32_t hashFnv(const void *pData, size_t len);
 
 	/* static variables */
 	static Pipe<PoolRequest> ppPoolRequests;
+	static std::atomic<ThreadPooling *> pPoolDirect;
+	static std::atomic<size_t> numSubmittersDirect;
+	static std::map<std::string, ThreadPooling *> pools;
+	static std::mutex mtxPools;
+	static thread_local ThreadPooling *pInternalTicking;
 
 	/* constants */
 
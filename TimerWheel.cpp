@@ -0,0 +1,263 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 17.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TimerWheel.h"
+#include "LibTime.h"
+
+using namespace std;
+
+typedef lock_guard<mutex> WheelGuard;
+
+mutex TimerWheel::mtxWheel;
+bool TimerWheel::slotsInitDone = false;
+uint32_t TimerWheel::msNext = 0;
+atomic<size_t> TimerWheel::numArmed(0);
+atomic<uint32_t> TimerWheel::msAdvanced(0);
+atomic<uint32_t> TimerWheel::numAdvances(0);
+WheelTimer TimerWheel::slots[TimerWheel::cNumLevels][TimerWheel::cNumSlots];
+
+/*
+ * Hierarchical timer wheel
+ *
+ * Four levels of 64 slots. A slot of level 0 covers 1ms, a slot
+ * of level n covers 64^n ms. Timers are placed on the lowest
+ * level covering their remaining time. Whenever level 0 wraps
+ * around, the current slot of the next level is cascaded down.
+ * Starting, cancelling and expiring a timer is O(1). Deadlines
+ * beyond the range of the wheel are placed on its last slot and
+ * reinserted when they get there.
+ *
+ * The wheel is advanced by drivers once per round. A timer is
+ * only checked with a single atomic load. If nobody advanced the
+ * wheel since the last check, the owner advances it instead.
+ *
+ * Literature
+ * - http://www.cs.columbia.edu/~nahum/w6998/papers/sosp87-timing-wheels.pdf
+ * - https://lwn.net/Articles/646950/
+ */
+void TimerWheel::timerStart(WheelTimer *pTimer, uint32_t durationMs)
+{
+	uint32_t nowMs = millis();
+	WheelGuard lock(mtxWheel);
+
+	if (!slotsInitDone)
+		slotsInit();
+
+	if (pTimer->armed)
+	{
+		timerUnlink(pTimer);
+		--numArmed;
+	}
+
+	// Empty wheel. Nothing to catch up
+	if (!numArmed)
+		msNext = nowMs;
+
+	pTimer->deadlineMs = nowMs + durationMs;
+	pTimer->numAdvancesSeen = numAdvances;
+
+	// Deadline passed by the wheel already
+	if ((int32_t)(pTimer->deadlineMs - msNext) < 0)
+	{
+		pTimer->armed = false;
+		pTimer->expired.store(true, memory_order_release);
+		return;
+	}
+
+	pTimer->armed = true;
+	pTimer->expired.store(false, memory_order_relaxed);
+
+	timerInsert(pTimer);
+	++numArmed;
+}
+
+void TimerWheel::timerCancel(WheelTimer *pTimer)
+{
+	WheelGuard lock(mtxWheel);
+
+	if (!pTimer->armed)
+		return;
+
+	timerUnlink(pTimer);
+	pTimer->armed = false;
+	--numArmed;
+}
+
+// Executed by the owner of the timer
+bool TimerWheel::timerExpired(WheelTimer *pTimer)
+{
+	uint32_t num;
+
+	if (pTimer->expired.load(memory_order_acquire))
+		return true;
+
+	num = numAdvances;
+
+	// Nobody else is advancing the wheel
+	if (num == pTimer->numAdvancesSeen)
+	{
+		advance();
+		num = numAdvances;
+	}
+
+	pTimer->numAdvancesSeen = num;
+
+	return pTimer->expired.load(memory_order_acquire);
+}
+
+void TimerWheel::advance()
+{
+	advance(millis());
+}
+
+void TimerWheel::advance(uint32_t nowMs)
+{
+	WheelTimer *pHead, *pTimer;
+	uint32_t idxSlot, ms;
+
+	++numAdvances;
+
+	if (!numArmed || nowMs == msAdvanced)
+		return;
+
+	// Another driver is advancing the wheel already
+	unique_lock<mutex> lock(mtxWheel, try_to_lock);
+	if (!lock.owns_lock())
+		return;
+
+	msAdvanced = nowMs;
+
+	while ((int32_t)(nowMs - msNext) >= 0)
+	{
+		idxSlot = msNext & (cNumSlots - 1);
+
+		if (!idxSlot &&
+				!slotCascade(1, (msNext >> cBitsSlots) & (cNumSlots - 1)) &&
+				!slotCascade(2, (msNext >> (2 * cBitsSlots)) & (cNumSlots - 1)))
+			slotCascade(3, (msNext >> (3 * cBitsSlots)) & (cNumSlots - 1));
+
+		ms = msNext;
+		++msNext;
+
+		pHead = &slots[0][idxSlot];
+
+		while (pHead->pNext != pHead)
+		{
+			pTimer = pHead->pNext;
+			timerUnlink(pTimer);
+
+			// Deadline was beyond the range of the wheel
+			if ((int32_t)(pTimer->deadlineMs - ms) > 0)
+			{
+				timerInsert(pTimer);
+				continue;
+			}
+
+			pTimer->armed = false;
+			--numArmed;
+
+			pTimer->expired.store(true, memory_order_release);
+		}
+
+		// Skip the remaining empty slots
+		if (!numArmed)
+		{
+			msNext = nowMs + 1;
+			break;
+		}
+	}
+}
+
+void TimerWheel::slotsInit()
+{
+	for (uint32_t l = 0; l < cNumLevels; ++l)
+	{
+		for (uint32_t s = 0; s < cNumSlots; ++s)
+		{
+			slots[l][s].pNext = &slots[l][s];
+			slots[l][s].pPrev = &slots[l][s];
+		}
+	}
+
+	slotsInitDone = true;
+}
+
+void TimerWheel::timerInsert(WheelTimer *pTimer)
+{
+	uint32_t placementMs = pTimer->deadlineMs;
+	uint32_t deltaMs, idxLevel, idxSlot;
+	WheelTimer *pHead;
+
+	if ((int32_t)(placementMs - msNext) < 0)
+		placementMs = msNext;
+
+	deltaMs = placementMs - msNext;
+
+	if (deltaMs >= (1UL << (cNumLevels * cBitsSlots)))
+	{
+		deltaMs = (1UL << (cNumLevels * cBitsSlots)) - 1;
+		placementMs = msNext + deltaMs;
+	}
+
+	for (idxLevel = 0; idxLevel < cNumLevels - 1; ++idxLevel)
+	{
+		if (deltaMs < (1UL << ((idxLevel + 1) * cBitsSlots)))
+			break;
+	}
+
+	idxSlot = (placementMs >> (idxLevel * cBitsSlots)) & (cNumSlots - 1);
+	pHead = &slots[idxLevel][idxSlot];
+
+	pTimer->pNext = pHead;
+	pTimer->pPrev = pHead->pPrev;
+	pHead->pPrev->pNext = pTimer;
+	pHead->pPrev = pTimer;
+}
+
+void TimerWheel::timerUnlink(WheelTimer *pTimer)
+{
+	pTimer->pPrev->pNext = pTimer->pNext;
+	pTimer->pNext->pPrev = pTimer->pPrev;
+
+	pTimer->pNext = NULL;
+	pTimer->pPrev = NULL;
+}
+
+// Returns the slot index. Next level is cascaded on zero
+uint32_t TimerWheel::slotCascade(uint32_t idxLevel, uint32_t idxSlot)
+{
+	WheelTimer *pHead = &slots[idxLevel][idxSlot];
+	WheelTimer *pTimer;
+
+	while (pHead->pNext != pHead)
+	{
+		pTimer = pHead->pNext;
+		timerUnlink(pTimer);
+		timerInsert(pTimer);
+	}
+
+	return idxSlot;
+}
+
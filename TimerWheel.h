@@ -0,0 +1,103 @@
+/*
+  This file is part of the DSP-Crowd project
+  https://www.dsp-crowd.com
+
+  Author(s):
+      - Johannes Natter, office@dsp-crowd.com
+
+  File created on 17.10.2026
+
+  Copyright (C) 2026, Johannes Natter
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <atomic>
+
+/*
+ * Timer node owned by the user. Must not be destroyed or
+ * restarted while armed without timerCancel().
+ */
+struct WheelTimer
+{
+	WheelTimer()
+		: pNext(NULL)
+		, pPrev(NULL)
+		, deadlineMs(0)
+		, numAdvancesSeen(0)
+		, armed(false)
+		, expired(false)
+	{}
+	WheelTimer *pNext;
+	WheelTimer *pPrev;
+	uint32_t deadlineMs;
+	uint32_t numAdvancesSeen;
+	bool armed;
+	std::atomic<bool> expired;
+};
+
+class TimerWheel
+{
+
+public:
+
+	static void timerStart(WheelTimer *pTimer, uint32_t durationMs);
+	static void timerCancel(WheelTimer *pTimer);
+	static bool timerExpired(WheelTimer *pTimer);
+
+	static void advance();
+	static void advance(uint32_t nowMs);
+
+private:
+
+	TimerWheel() = delete;
+	TimerWheel(const TimerWheel &) = delete;
+	TimerWheel &operator=(const TimerWheel &) = delete;
+
+	/*
+	 * Naming of functions:  objectVerb()
+	 * Example:              peerAdd()
+	 */
+
+	/* static functions */
+	static void slotsInit();
+	static void timerInsert(WheelTimer *pTimer);
+	static void timerUnlink(WheelTimer *pTimer);
+	static uint32_t slotCascade(uint32_t idxLevel, uint32_t idxSlot);
+
+	/* static variables */
+	static std::mutex mtxWheel;
+	static bool slotsInitDone;
+	static uint32_t msNext;
+	static std::atomic<size_t> numArmed;
+	static std::atomic<uint32_t> msAdvanced;
+	static std::atomic<uint32_t> numAdvances;
+
+	/* constants */
+	static const uint32_t cNumLevels = 4;
+	static const uint32_t cBitsSlots = 6;
+	static const uint32_t cNumSlots = 1 << cBitsSlots;
+
+	static WheelTimer slots[cNumLevels][cNumSlots];
+
+};
+
+#endif
+